@@ -0,0 +1,69 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/standard.h"
+
+// A synthetic block close to the block size limit: a coinbase followed by
+// transactions spending two random outpoints into two P2PKH outputs each.
+static CBlock CreateFullBlock()
+{
+    CBlock block;
+    block.nVersion = 1;
+    block.nTime = 1408732505;
+    block.nBits = 0x1e0fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1))));
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vout.resize(2);
+    unsigned int nBlockSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) + 2; // room for a larger vtx count
+    for (unsigned int i = 0; ; i++) {
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            tx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(72, 0) << std::vector<unsigned char>(33, 2);
+        }
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = COIN + i;
+            tx.vout[j].scriptPubKey = coinbase.vout[0].scriptPubKey;
+        }
+        nBlockSize += ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (nBlockSize > MAX_BLOCK_SIZE)
+            break;
+        block.vtx.push_back(tx);
+    }
+
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static void CheckFullBlock(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const CBlock blockOrig = CreateFullBlock();
+
+    while (state.KeepRunning()) {
+        CBlock block(blockOrig); // fresh copy, CheckBlock() remembers a successful check
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, false, true));
+    }
+}
+
+BENCHMARK(CheckFullBlock);
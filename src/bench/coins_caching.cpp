@@ -0,0 +1,51 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+
+#include <vector>
+
+namespace {
+// Backing view that accepts and drops everything flushed into it
+class CCoinsViewSink : public CCoinsView
+{
+public:
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        mapCoins.clear();
+        return true;
+    }
+};
+}
+
+// Flush a cache holding the outputs of a few thousand new transactions
+static void CCoinsViewCacheFlush(benchmark::State& state)
+{
+    CCoinsViewSink sink;
+    std::vector<uint256> vTxid(5000);
+    for (size_t i = 0; i < vTxid.size(); i++)
+        vTxid[i] = GetRandHash();
+
+    CTxOut txout;
+    txout.nValue = COIN;
+    txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&sink);
+        for (size_t i = 0; i < vTxid.size(); i++) {
+            CCoinsModifier coins = cache.ModifyNewCoins(vTxid[i]);
+            coins->nVersion = 1;
+            coins->nHeight = 1;
+            coins->vout.assign(2, txout);
+        }
+        cache.SetBestBlock(vTxid[0]);
+        assert(cache.Flush());
+    }
+}
+
+BENCHMARK(CCoinsViewCacheFlush);
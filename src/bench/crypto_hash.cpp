@@ -0,0 +1,60 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/neoscrypt.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <vector>
+
+// Measures the kernels neoscrypt_autodetect() picked for this processor, or
+// neoscrypt_asm.S if crypto/neoscrypt.c was built with -DASM.
+static void NeoScrypt(benchmark::State& state)
+{
+    unsigned char input[CBlockHeader::HEADER_SIZE] = {};
+    uint256 hash;
+    while (state.KeepRunning()) {
+        neoscrypt(input, hash.begin(), 0x0);
+        input[0]++;
+    }
+}
+
+static void BlockHeaderHash(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.nBits = 0x1e0fffff;
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.GetHash();
+    }
+}
+
+static void BlockHeaderHashCached(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.nBits = 0x1e0fffff;
+    while (state.KeepRunning()) {
+        header.GetHash();
+    }
+}
+
+static void SHA256_1M(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(1000000, 0);
+    while (state.KeepRunning())
+        CSHA256().Write(begin_ptr(in), in.size()).Finalize(hash);
+}
+
+BENCHMARK(NeoScrypt);
+BENCHMARK(BlockHeaderHash);
+BENCHMARK(BlockHeaderHashCached);
+BENCHMARK(SHA256_1M);
@@ -0,0 +1,80 @@
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "main.h"
+#include "masternodeman.h"
+#include "random.h"
+
+#include <vector>
+
+static const int NUM_MASTERNODES = 5000;
+static const int NUM_BLOCKS = 100;
+
+// Fills mnodeman with synthetic enabled masternodes and chainActive with a
+// chain of blocks to rank them against, and cleans both up again.
+class MasternodeRanksSetup
+{
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+
+public:
+    MasternodeRanksSetup() : vHashes(NUM_BLOCKS), vBlocks(NUM_BLOCKS)
+    {
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            vHashes[i] = GetRandHash();
+            vBlocks[i].phashBlock = &vHashes[i];
+            vBlocks[i].pprev = i ? &vBlocks[i - 1] : NULL;
+            vBlocks[i].nHeight = i;
+            vBlocks[i].BuildSkip();
+        }
+        {
+            LOCK(cs_main);
+            chainActive.SetTip(&vBlocks.back());
+        }
+
+        for (int i = 0; i < NUM_MASTERNODES; i++) {
+            CMasternode mn;
+            mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+            mn.nProtocolVersion = PROTOCOL_VERSION;
+            mn.nActiveState = CMasternode::MASTERNODE_ENABLED;
+            mnodeman.Add(mn);
+        }
+    }
+
+    ~MasternodeRanksSetup()
+    {
+        mnodeman.Clear();
+        LOCK(cs_main);
+        chainActive.SetTip(NULL);
+    }
+};
+
+// Full ranking for a different block every time
+static void MasternodeRanks(benchmark::State& state)
+{
+    MasternodeRanksSetup setup;
+    int nHeight = 0;
+    while (state.KeepRunning()) {
+        assert(mnodeman.GetMasternodeRanks(nHeight).size() == NUM_MASTERNODES);
+        nHeight = (nHeight + 1) % NUM_BLOCKS;
+    }
+}
+
+// Rank of a single masternode for the same few blocks, as vote checks do
+static void MasternodeRankLookup(benchmark::State& state)
+{
+    MasternodeRanksSetup setup;
+    std::vector<CMasternode> vMasternodes = mnodeman.GetFullMasternodeVector();
+    int i = 0;
+    while (state.KeepRunning()) {
+        assert(mnodeman.GetMasternodeRank(vMasternodes[i % NUM_MASTERNODES].vin, NUM_BLOCKS - 1 - i % 4) > 0);
+        i++;
+    }
+}
+
+BENCHMARK(MasternodeRanks);
+BENCHMARK(MasternodeRankLookup);
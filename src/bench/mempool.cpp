@@ -0,0 +1,47 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <list>
+#include <vector>
+
+// Add a block worth of independent transactions to the mempool and remove
+// them again the way a connected block does
+static void MempoolAddRemoveForBlock(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx;
+    for (unsigned int i = 0; i < 2000; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0) << std::vector<unsigned char>(33, 2);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+        vtx.push_back(tx);
+    }
+
+    CTxMemPool pool(CFeeRate(0));
+    LockPoints lp;
+
+    while (state.KeepRunning()) {
+        LOCK(pool.cs);
+        for (unsigned int i = 0; i < vtx.size(); i++) {
+            CTxMemPoolEntry entry(vtx[i], 1000 + i, GetTime(), 0.0, 1, true, vtx[i].GetValueOut(), false, 1, lp);
+            pool.addUnchecked(vtx[i].GetHash(), entry, false);
+        }
+        std::list<CTransaction> conflicts;
+        pool.removeForBlock(vtx, 2, conflicts, false);
+        assert(pool.size() == 0);
+    }
+}
+
+BENCHMARK(MempoolAddRemoveForBlock);
@@ -0,0 +1,40 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <vector>
+
+// Signature checks that hit the signature cache, as happens when a block
+// contains transactions that were already verified on mempool acceptance
+static void SigCacheLookup(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    std::vector<uint256> vSighash(1000);
+    std::vector<std::vector<unsigned char> > vSig(vSighash.size());
+    CTransaction tx;
+    CachingTransactionSignatureChecker checker(&tx, 0, true);
+    for (size_t i = 0; i < vSighash.size(); i++) {
+        vSighash[i] = GetRandHash();
+        assert(key.Sign(vSighash[i], vSig[i]));
+        assert(checker.VerifySignature(vSig[i], pubkey, vSighash[i]));
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        assert(checker.VerifySignature(vSig[i], pubkey, vSighash[i]));
+        i = (i + 1) % vSighash.size();
+    }
+}
+
+BENCHMARK(SigCacheLookup);
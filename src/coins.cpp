@@ -42,6 +42,15 @@ bool CCoins::Spend(uint32_t nPos)
 }
 
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
+void CCoinsView::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const {
+    BOOST_FOREACH(const uint256 &txid, vTxid) {
+        CCoins coins;
+        if (GetCoins(txid, coins)) {
+            vCoinsRet.push_back(std::make_pair(txid, CCoins()));
+            vCoinsRet.back().second.swap(coins);
+        }
+    }
+}
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
@@ -50,6 +59,7 @@ bool CCoinsView::GetStats(CCoinsStats &stats) const { return false; }
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { return base->GetCoins(txid, coins); }
+void CCoinsViewBacked::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const { base->GetCoinsBatch(vTxid, vCoinsRet); }
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
@@ -76,15 +86,50 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
-    CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
-    tmp.swap(ret->second.coins);
-    if (ret->second.coins.IsPruned()) {
+    return InsertFetchedCoins(txid, tmp);
+}
+
+CCoinsMap::iterator CCoinsViewCache::InsertFetchedCoins(const uint256 &txid, CCoins &coins) const {
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second) {
+        // Already cached, possibly modified since it was retrieved
+        coins.Clear();
+        return ret.first;
+    }
+    coins.swap(ret.first->second.coins);
+    if (ret.first->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
         // version as fresh.
-        ret->second.flags = CCoinsCacheEntry::FRESH;
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
     }
-    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
-    return ret;
+    cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
+    return ret.first;
+}
+
+void CCoinsViewCache::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const {
+    PrefetchCoins(vTxid);
+    BOOST_FOREACH(const uint256 &txid, vTxid) {
+        CCoinsMap::const_iterator it = cacheCoins.find(txid);
+        if (it != cacheCoins.end())
+            vCoinsRet.push_back(std::make_pair(txid, it->second.coins));
+    }
+}
+
+size_t CCoinsViewCache::PrefetchCoins(const std::vector<uint256> &vTxid) const {
+    std::vector<uint256> vMissing;
+    BOOST_FOREACH(const uint256 &txid, vTxid) {
+        if (!cacheCoins.count(txid))
+            vMissing.push_back(txid);
+    }
+    if (vMissing.empty())
+        return 0;
+
+    std::vector<std::pair<uint256, CCoins> > vCoins;
+    vCoins.reserve(vMissing.size());
+    base->GetCoinsBatch(vMissing, vCoins);
+    for (std::vector<std::pair<uint256, CCoins> >::iterator it = vCoins.begin(); it != vCoins.end(); ++it)
+        InsertFetchedCoins(it->first, it->second);
+    return vCoins.size();
 }
 
 bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
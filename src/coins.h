@@ -318,6 +318,10 @@ public:
     //! Retrieve the CCoins (unspent transaction outputs) for a given txid
     virtual bool GetCoins(const uint256 &txid, CCoins &coins) const;
 
+    //! Retrieve the CCoins for several txids at once. The ones found are appended
+    //! to vCoinsRet, in any order. By default this calls GetCoins for each txid.
+    virtual void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const;
+
     //! Just check whether we have data for a given txid.
     //! This may (but cannot always) return true for fully spent transactions
     virtual bool HaveCoins(const uint256 &txid) const;
@@ -346,6 +350,7 @@ protected:
 public:
     CCoinsViewBacked(CCoinsView *viewIn);
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
@@ -400,6 +405,7 @@ public:
 
     // Standard CCoinsView methods
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
@@ -419,6 +425,13 @@ public:
      */
     const CCoins* AccessCoins(const uint256 &txid) const;
 
+    /**
+     * Load the CCoins for the given txids into the cache ahead of their use.
+     * The ones not cached yet are retrieved from the backing view in one
+     * GetCoinsBatch call. Returns the number of entries loaded.
+     */
+    size_t PrefetchCoins(const std::vector<uint256> &vTxid) const;
+
     /**
      * Return a modifiable reference to a CCoins. If no entry with the given
      * txid exists, a new one is created. Simultaneous modifications are not
@@ -483,6 +496,8 @@ public:
 private:
     CCoinsMap::iterator FetchCoins(const uint256 &txid);
     CCoinsMap::const_iterator FetchCoins(const uint256 &txid) const;
+    //! Add coins retrieved from the backing view to the cache, coins is left empty
+    CCoinsMap::iterator InsertFetchedCoins(const uint256 &txid, CCoins &coins) const;
 
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
@@ -647,6 +647,244 @@ static void neoscrypt_chacha(uint *X, uint rounds) {
 #undef quarter
 }
 
+/* ChaCha20 over Z and Salsa20 over X, rounds must be a multiple of 2;
+ * the double mix of NeoScrypt runs the two side by side */
+static void neoscrypt_chacha_salsa(uint *Z, uint *X, uint rounds) {
+    neoscrypt_chacha(Z, rounds);
+    neoscrypt_salsa(X, rounds);
+}
+
+/* Mixing kernels in use by the block mixers;
+ * the portable ones until neoscrypt_autodetect() is called */
+static void (*neoscrypt_salsa_kernel)(uint *X, uint rounds) = neoscrypt_salsa;
+static void (*neoscrypt_chacha_kernel)(uint *X, uint rounds) = neoscrypt_chacha;
+static void (*neoscrypt_chacha_salsa_kernel)(uint *Z, uint *X, uint rounds) =
+  neoscrypt_chacha_salsa;
+
+/* Vectorised kernels for x86 processors. These are compiled with
+ * per-function target attributes, so the binary still runs on processors
+ * without the extensions; neoscrypt_autodetect() selects them at run time
+ * after checking them against the portable code above.
+ *
+ * A single Salsa20 or ChaCha20 block is bound by the latency of its
+ * quarter rounds, so vectorising one block alone gains little. The double
+ * mix has two independent blocks in flight though, and interleaving them
+ * in one kernel keeps the vector units busy */
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+  (defined(__clang__) || (__GNUC__ > 4) || \
+  ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define NEOSCRYPT_X86_SIMD
+#endif
+
+#ifdef NEOSCRYPT_X86_SIMD
+
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+/* The state is kept as four rows of four words each; the quarter rounds
+ * run on all columns at once and the rows are rotated in between to turn
+ * columns into diagonals and back. Salsa20 keeps the diagonals in rows */
+
+#define ROTL128(a, b) \
+    _mm_or_si128(_mm_slli_epi32((a), (b)), _mm_srli_epi32((a), 32 - (b)))
+
+#define SALSA_LOAD(X, a, b, c, d) \
+    a = _mm_set_epi32(X[15], X[10], X[5],  X[0]); \
+    b = _mm_set_epi32(X[3],  X[14], X[9],  X[4]); \
+    c = _mm_set_epi32(X[7],  X[2],  X[13], X[8]); \
+    d = _mm_set_epi32(X[11], X[6],  X[1],  X[12]);
+
+#define SALSA_STORE(X, a, b, c, d) { \
+    uint T[16]; \
+    _mm_storeu_si128((__m128i *) &T[0],  a); \
+    _mm_storeu_si128((__m128i *) &T[4],  b); \
+    _mm_storeu_si128((__m128i *) &T[8],  c); \
+    _mm_storeu_si128((__m128i *) &T[12], d); \
+    X[0]  += T[0];  X[5]  += T[1];  X[10] += T[2];  X[15] += T[3]; \
+    X[4]  += T[4];  X[9]  += T[5];  X[14] += T[6];  X[3]  += T[7]; \
+    X[8]  += T[8];  X[13] += T[9];  X[2]  += T[10]; X[7]  += T[11]; \
+    X[12] += T[12]; X[1]  += T[13]; X[6]  += T[14]; X[11] += T[15]; }
+
+#define SALSA_DROUND(a, b, c, d, t) \
+    t = _mm_add_epi32(a, d); b = _mm_xor_si128(b, ROTL128(t,  7)); \
+    t = _mm_add_epi32(b, a); c = _mm_xor_si128(c, ROTL128(t,  9)); \
+    t = _mm_add_epi32(c, b); d = _mm_xor_si128(d, ROTL128(t, 13)); \
+    t = _mm_add_epi32(d, c); a = _mm_xor_si128(a, ROTL128(t, 18)); \
+    t = b; \
+    b = _mm_shuffle_epi32(d, _MM_SHUFFLE(0, 3, 2, 1)); \
+    c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2)); \
+    d = _mm_shuffle_epi32(t, _MM_SHUFFLE(2, 1, 0, 3)); \
+    t = _mm_add_epi32(a, d); b = _mm_xor_si128(b, ROTL128(t,  7)); \
+    t = _mm_add_epi32(b, a); c = _mm_xor_si128(c, ROTL128(t,  9)); \
+    t = _mm_add_epi32(c, b); d = _mm_xor_si128(d, ROTL128(t, 13)); \
+    t = _mm_add_epi32(d, c); a = _mm_xor_si128(a, ROTL128(t, 18)); \
+    t = b; \
+    b = _mm_shuffle_epi32(d, _MM_SHUFFLE(0, 3, 2, 1)); \
+    c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2)); \
+    d = _mm_shuffle_epi32(t, _MM_SHUFFLE(2, 1, 0, 3));
+
+#define CHACHA_LOAD(X, a, b, c, d) \
+    a = _mm_loadu_si128((__m128i *) &X[0]); \
+    b = _mm_loadu_si128((__m128i *) &X[4]); \
+    c = _mm_loadu_si128((__m128i *) &X[8]); \
+    d = _mm_loadu_si128((__m128i *) &X[12]);
+
+#define CHACHA_STORE(X, a, b, c, d) \
+    _mm_storeu_si128((__m128i *) &X[0], \
+      _mm_add_epi32(_mm_loadu_si128((__m128i *) &X[0]), a)); \
+    _mm_storeu_si128((__m128i *) &X[4], \
+      _mm_add_epi32(_mm_loadu_si128((__m128i *) &X[4]), b)); \
+    _mm_storeu_si128((__m128i *) &X[8], \
+      _mm_add_epi32(_mm_loadu_si128((__m128i *) &X[8]), c)); \
+    _mm_storeu_si128((__m128i *) &X[12], \
+      _mm_add_epi32(_mm_loadu_si128((__m128i *) &X[12]), d));
+
+/* ROT16 and ROT8 rotate every word left by 16 and 8 bits */
+#define CHACHA_QUARTER(a, b, c, d, t, ROT16, ROT8) \
+    a = _mm_add_epi32(a, b); t = _mm_xor_si128(d, a); d = ROT16(t); \
+    c = _mm_add_epi32(c, d); t = _mm_xor_si128(b, c); b = ROTL128(t, 12); \
+    a = _mm_add_epi32(a, b); t = _mm_xor_si128(d, a); d = ROT8(t); \
+    c = _mm_add_epi32(c, d); t = _mm_xor_si128(b, c); b = ROTL128(t,  7);
+
+#define CHACHA_DROUND(a, b, c, d, t, ROT16, ROT8) \
+    CHACHA_QUARTER(a, b, c, d, t, ROT16, ROT8); \
+    b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1)); \
+    c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2)); \
+    d = _mm_shuffle_epi32(d, _MM_SHUFFLE(2, 1, 0, 3)); \
+    CHACHA_QUARTER(a, b, c, d, t, ROT16, ROT8); \
+    b = _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 0, 3)); \
+    c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2)); \
+    d = _mm_shuffle_epi32(d, _MM_SHUFFLE(0, 3, 2, 1));
+
+#define ROT16_SSE2(t) \
+    _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, _MM_SHUFFLE(2, 3, 0, 1)), \
+      _MM_SHUFFLE(2, 3, 0, 1))
+#define ROT8_SSE2(t)   ROTL128(t, 8)
+#define ROT16_SSSE3(t) _mm_shuffle_epi8(t, rot16)
+#define ROT8_SSSE3(t)  _mm_shuffle_epi8(t, rot8)
+
+#define SSSE3_ROTATIONS \
+    const __m128i rot16 = _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, \
+      5, 4, 7, 6, 1, 0, 3, 2); \
+    const __m128i rot8  = _mm_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, \
+      6, 5, 4, 7, 2, 1, 0, 3);
+
+/* Salsa20 with SSE2, rounds must be a multiple of 2 */
+__attribute__((target("sse2")))
+static void neoscrypt_salsa_sse2(uint *X, uint rounds) {
+    __m128i a, b, c, d, t;
+
+    SALSA_LOAD(X, a, b, c, d);
+    for(; rounds; rounds -= 2) {
+        SALSA_DROUND(a, b, c, d, t);
+    }
+    SALSA_STORE(X, a, b, c, d);
+}
+
+/* ChaCha20 with SSSE3, rounds must be a multiple of 2;
+ * the 16-bit and 8-bit rotations become single byte shuffles */
+__attribute__((target("ssse3")))
+static void neoscrypt_chacha_ssse3(uint *X, uint rounds) {
+    SSSE3_ROTATIONS
+    __m128i a, b, c, d, t;
+
+    CHACHA_LOAD(X, a, b, c, d);
+    for(; rounds; rounds -= 2) {
+        CHACHA_DROUND(a, b, c, d, t, ROT16_SSSE3, ROT8_SSSE3);
+    }
+    CHACHA_STORE(X, a, b, c, d);
+}
+
+/* ChaCha20 over Z and Salsa20 over X with SSE2 */
+__attribute__((target("sse2")))
+static void neoscrypt_chacha_salsa_sse2(uint *Z, uint *X, uint rounds) {
+    __m128i a, b, c, d, t, e, f, g, h, u;
+
+    CHACHA_LOAD(Z, a, b, c, d);
+    SALSA_LOAD(X, e, f, g, h);
+    for(; rounds; rounds -= 2) {
+        CHACHA_DROUND(a, b, c, d, t, ROT16_SSE2, ROT8_SSE2);
+        SALSA_DROUND(e, f, g, h, u);
+    }
+    CHACHA_STORE(Z, a, b, c, d);
+    SALSA_STORE(X, e, f, g, h);
+}
+
+/* ChaCha20 over Z and Salsa20 over X with SSSE3 */
+__attribute__((target("ssse3")))
+static void neoscrypt_chacha_salsa_ssse3(uint *Z, uint *X, uint rounds) {
+    SSSE3_ROTATIONS
+    __m128i a, b, c, d, t, e, f, g, h, u;
+
+    CHACHA_LOAD(Z, a, b, c, d);
+    SALSA_LOAD(X, e, f, g, h);
+    for(; rounds; rounds -= 2) {
+        CHACHA_DROUND(a, b, c, d, t, ROT16_SSSE3, ROT8_SSSE3);
+        SALSA_DROUND(e, f, g, h, u);
+    }
+    CHACHA_STORE(Z, a, b, c, d);
+    SALSA_STORE(X, e, f, g, h);
+}
+
+#undef SSSE3_ROTATIONS
+#undef ROT8_SSSE3
+#undef ROT16_SSSE3
+#undef ROT8_SSE2
+#undef ROT16_SSE2
+#undef CHACHA_DROUND
+#undef CHACHA_QUARTER
+#undef CHACHA_STORE
+#undef CHACHA_LOAD
+#undef SALSA_DROUND
+#undef SALSA_STORE
+#undef SALSA_LOAD
+#undef ROTL128
+
+/* Fills a few blocks with pseudorandom data */
+static void neoscrypt_kernel_test_data(uint *X, uint len) {
+    uint i, seed = 0x9E3779B9;
+
+    for(i = 0; i < len; i++) {
+        seed = seed * 1664525 + 1013904223;
+        X[i] = seed;
+    }
+}
+
+/* Checks a single block kernel against the portable reference
+ * with both round counts NeoScrypt uses */
+static int neoscrypt_kernel_test(void (*kernel)(uint *X, uint rounds),
+  void (*reference)(uint *X, uint rounds)) {
+    uint A[64], B[64], i;
+
+    neoscrypt_kernel_test_data(A, 64);
+    neoscrypt_copy(B, A, sizeof(A));
+    for(i = 0; i < 4; i++) {
+        kernel(&A[16 * i], (i & 1) ? 8 : 20);
+        reference(&B[16 * i], (i & 1) ? 8 : 20);
+    }
+
+    return(!memcmp(A, B, sizeof(A)));
+}
+
+/* Same for a double mix kernel */
+static int neoscrypt_kernel_test_dbl(
+  void (*kernel)(uint *Z, uint *X, uint rounds)) {
+    uint A[64], B[64], i;
+
+    neoscrypt_kernel_test_data(A, 64);
+    neoscrypt_copy(B, A, sizeof(A));
+    for(i = 0; i < 2; i++) {
+        kernel(&A[32 * i], &A[32 * i + 16], i ? 8 : 20);
+        neoscrypt_chacha_salsa(&B[32 * i], &B[32 * i + 16], i ? 8 : 20);
+    }
+
+    return(!memcmp(A, B, sizeof(A)));
+}
+
+#endif /* NEOSCRYPT_X86_SIMD */
+
 /* Fast 32-bit / 64-bit memcpy();
  * len must be a multiple of 32 bytes */
 static void neoscrypt_blkcpy(void *dstp, const void *srcp, uint len) {
@@ -2493,14 +2731,14 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
     if(r == 1) {
         if(mixer) {
             neoscrypt_blkxor(&X[0], &X[16], BLOCK_SIZE);
-            neoscrypt_chacha(&X[0], rounds);
+            neoscrypt_chacha_kernel(&X[0], rounds);
             neoscrypt_blkxor(&X[16], &X[0], BLOCK_SIZE);
-            neoscrypt_chacha(&X[16], rounds);
+            neoscrypt_chacha_kernel(&X[16], rounds);
         } else {
             neoscrypt_blkxor(&X[0], &X[16], BLOCK_SIZE);
-            neoscrypt_salsa(&X[0], rounds);
+            neoscrypt_salsa_kernel(&X[0], rounds);
             neoscrypt_blkxor(&X[16], &X[0], BLOCK_SIZE);
-            neoscrypt_salsa(&X[16], rounds);
+            neoscrypt_salsa_kernel(&X[16], rounds);
         }
         return;
     }
@@ -2508,23 +2746,23 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
     if(r == 2) {
         if(mixer) {
             neoscrypt_blkxor(&X[0], &X[48], BLOCK_SIZE);
-            neoscrypt_chacha(&X[0], rounds);
+            neoscrypt_chacha_kernel(&X[0], rounds);
             neoscrypt_blkxor(&X[16], &X[0], BLOCK_SIZE);
-            neoscrypt_chacha(&X[16], rounds);
+            neoscrypt_chacha_kernel(&X[16], rounds);
             neoscrypt_blkxor(&X[32], &X[16], BLOCK_SIZE);
-            neoscrypt_chacha(&X[32], rounds);
+            neoscrypt_chacha_kernel(&X[32], rounds);
             neoscrypt_blkxor(&X[48], &X[32], BLOCK_SIZE);
-            neoscrypt_chacha(&X[48], rounds);
+            neoscrypt_chacha_kernel(&X[48], rounds);
             neoscrypt_blkswp(&X[16], &X[32], BLOCK_SIZE);
         } else {
             neoscrypt_blkxor(&X[0], &X[48], BLOCK_SIZE);
-            neoscrypt_salsa(&X[0], rounds);
+            neoscrypt_salsa_kernel(&X[0], rounds);
             neoscrypt_blkxor(&X[16], &X[0], BLOCK_SIZE);
-            neoscrypt_salsa(&X[16], rounds);
+            neoscrypt_salsa_kernel(&X[16], rounds);
             neoscrypt_blkxor(&X[32], &X[16], BLOCK_SIZE);
-            neoscrypt_salsa(&X[32], rounds);
+            neoscrypt_salsa_kernel(&X[32], rounds);
             neoscrypt_blkxor(&X[48], &X[32], BLOCK_SIZE);
-            neoscrypt_salsa(&X[48], rounds);
+            neoscrypt_salsa_kernel(&X[48], rounds);
             neoscrypt_blkswp(&X[16], &X[32], BLOCK_SIZE);
         }
         return;
@@ -2535,9 +2773,9 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
         if(i) neoscrypt_blkxor(&X[16 * i], &X[16 * (i - 1)], BLOCK_SIZE);
         else  neoscrypt_blkxor(&X[0], &X[16 * (2 * r - 1)], BLOCK_SIZE);
         if(mixer)
-          neoscrypt_chacha(&X[16 * i], rounds);
+          neoscrypt_chacha_kernel(&X[16 * i], rounds);
         else
-          neoscrypt_salsa(&X[16 * i], rounds);
+          neoscrypt_salsa_kernel(&X[16 * i], rounds);
         neoscrypt_blkcpy(&Y[16 * i], &X[16 * i], BLOCK_SIZE);
     }
     for(i = 0; i < r; i++)
@@ -2547,6 +2785,37 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
 }
 
 
+/* Block mixer for the double mix with r of 1 or 2; does the same as
+ * blkmix(Z) with ChaCha followed by blkmix(X) with Salsa */
+static void neoscrypt_blkmix_dbl(uint *Z, uint *X, uint r, uint rounds) {
+
+    if(r == 1) {
+        neoscrypt_blkxor(&Z[0], &Z[16], BLOCK_SIZE);
+        neoscrypt_blkxor(&X[0], &X[16], BLOCK_SIZE);
+        neoscrypt_chacha_salsa_kernel(&Z[0], &X[0], rounds);
+        neoscrypt_blkxor(&Z[16], &Z[0], BLOCK_SIZE);
+        neoscrypt_blkxor(&X[16], &X[0], BLOCK_SIZE);
+        neoscrypt_chacha_salsa_kernel(&Z[16], &X[16], rounds);
+        return;
+    }
+
+    neoscrypt_blkxor(&Z[0], &Z[48], BLOCK_SIZE);
+    neoscrypt_blkxor(&X[0], &X[48], BLOCK_SIZE);
+    neoscrypt_chacha_salsa_kernel(&Z[0], &X[0], rounds);
+    neoscrypt_blkxor(&Z[16], &Z[0], BLOCK_SIZE);
+    neoscrypt_blkxor(&X[16], &X[0], BLOCK_SIZE);
+    neoscrypt_chacha_salsa_kernel(&Z[16], &X[16], rounds);
+    neoscrypt_blkxor(&Z[32], &Z[16], BLOCK_SIZE);
+    neoscrypt_blkxor(&X[32], &X[16], BLOCK_SIZE);
+    neoscrypt_chacha_salsa_kernel(&Z[32], &X[32], rounds);
+    neoscrypt_blkxor(&Z[48], &Z[32], BLOCK_SIZE);
+    neoscrypt_blkxor(&X[48], &X[32], BLOCK_SIZE);
+    neoscrypt_chacha_salsa_kernel(&Z[48], &X[48], rounds);
+    neoscrypt_blkswp(&Z[16], &Z[32], BLOCK_SIZE);
+    neoscrypt_blkswp(&X[16], &X[32], BLOCK_SIZE);
+}
+
+
 /* NeoScrypt core engine:
  * p = 1, salt = password;
  * Basic customisation (required):
@@ -2581,8 +2850,8 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
 void neoscrypt(const uchar *password, uchar *output, uint profile) {
     const size_t stack_align = 0x40;
     uint N = 128, r = 2, dblmix = 1, mixmode = 0x14;
-    uint kdf, i, j;
-    uint *X, *Y, *Z, *V;
+    uint kdf, paired, i, j, k;
+    uint *X, *Y, *Z, *V, *W;
 
     if(profile & 0x1) {
         N = 1024;        /* N = (1 << (Nfactor + 1)); */
@@ -2596,7 +2865,11 @@ void neoscrypt(const uchar *password, uchar *output, uint profile) {
         r = (1 << ((profile >> 5) & 0x7));
     }
 
-    uchar stack[(N + 3) * r * 2 * BLOCK_SIZE + stack_align];
+    /* ChaCha and Salsa run side by side with a scratchpad each if
+     * there is a block mixer for it */
+    paired = dblmix && (r <= 2);
+
+    uchar stack[((paired + 1) * N + 3) * r * 2 * BLOCK_SIZE + stack_align];
     /* X = r * 2 * BLOCK_SIZE */
     X = (uint *) (((size_t)stack & ~(stack_align - 1)) + stack_align);
     /* Z is a copy of X for ChaCha */
@@ -2605,6 +2878,8 @@ void neoscrypt(const uchar *password, uchar *output, uint profile) {
     Y = &X[64 * r];
     /* V = N * r * 2 * BLOCK_SIZE */
     V = &X[96 * r];
+    /* W = N * r * 2 * BLOCK_SIZE for Salsa if paired */
+    W = &V[32 * r * N];
 
     /* X = KDF(password, salt) */
     kdf = (profile >> 1) & 0xF;
@@ -2639,47 +2914,75 @@ void neoscrypt(const uchar *password, uchar *output, uint profile) {
 
     /* Process ChaCha 1st, Salsa 2nd and XOR them into FastKDF; otherwise Salsa only */
 
-    if(dblmix) {
+    if(paired) {
         /* blkcpy(Z, X) */
         neoscrypt_blkcpy(&Z[0], &X[0], r * 2 * BLOCK_SIZE);
 
-        /* Z = SMix(Z) */
+        /* Z = SMix(Z), X = SMix(X) */
         for(i = 0; i < N; i++) {
-            /* blkcpy(V, Z) */
+            /* blkcpy(V, Z), blkcpy(W, X) */
             neoscrypt_blkcpy(&V[i * (32 * r)], &Z[0], r * 2 * BLOCK_SIZE);
-            /* blkmix(Z, Y) */
-            neoscrypt_blkmix(&Z[0], &Y[0], r, (mixmode | 0x0100));
+            neoscrypt_blkcpy(&W[i * (32 * r)], &X[0], r * 2 * BLOCK_SIZE);
+            /* blkmix(Z), blkmix(X) */
+            neoscrypt_blkmix_dbl(&Z[0], &X[0], r, mixmode);
         }
 
         for(i = 0; i < N; i++) {
-            /* integerify(Z) mod N */
+            /* integerify(Z) mod N, integerify(X) mod N */
             j = (32 * r) * (Z[16 * (2 * r - 1)] & (N - 1));
-            /* blkxor(Z, V) */
+            k = (32 * r) * (X[16 * (2 * r - 1)] & (N - 1));
+            /* blkxor(Z, V), blkxor(X, W) */
             neoscrypt_blkxor(&Z[0], &V[j], r * 2 * BLOCK_SIZE);
-            /* blkmix(Z, Y) */
-            neoscrypt_blkmix(&Z[0], &Y[0], r, (mixmode | 0x0100));
+            neoscrypt_blkxor(&X[0], &W[k], r * 2 * BLOCK_SIZE);
+            /* blkmix(Z), blkmix(X) */
+            neoscrypt_blkmix_dbl(&Z[0], &X[0], r, mixmode);
         }
-    }
 
-    /* X = SMix(X) */
-    for(i = 0; i < N; i++) {
-        /* blkcpy(V, X) */
-        neoscrypt_blkcpy(&V[i * (32 * r)], &X[0], r * 2 * BLOCK_SIZE);
-        /* blkmix(X, Y) */
-        neoscrypt_blkmix(&X[0], &Y[0], r, mixmode);
-    }
-    for(i = 0; i < N; i++) {
-        /* integerify(X) mod N */
-        j = (32 * r) * (X[16 * (2 * r - 1)] & (N - 1));
-        /* blkxor(X, V) */
-        neoscrypt_blkxor(&X[0], &V[j], r * 2 * BLOCK_SIZE);
-        /* blkmix(X, Y) */
-        neoscrypt_blkmix(&X[0], &Y[0], r, mixmode);
-    }
+        /* blkxor(X, Z) */
+        neoscrypt_blkxor(&X[0], &Z[0], r * 2 * BLOCK_SIZE);
+    } else {
+        if(dblmix) {
+            /* blkcpy(Z, X) */
+            neoscrypt_blkcpy(&Z[0], &X[0], r * 2 * BLOCK_SIZE);
+
+            /* Z = SMix(Z) */
+            for(i = 0; i < N; i++) {
+                /* blkcpy(V, Z) */
+                neoscrypt_blkcpy(&V[i * (32 * r)], &Z[0], r * 2 * BLOCK_SIZE);
+                /* blkmix(Z, Y) */
+                neoscrypt_blkmix(&Z[0], &Y[0], r, (mixmode | 0x0100));
+            }
+
+            for(i = 0; i < N; i++) {
+                /* integerify(Z) mod N */
+                j = (32 * r) * (Z[16 * (2 * r - 1)] & (N - 1));
+                /* blkxor(Z, V) */
+                neoscrypt_blkxor(&Z[0], &V[j], r * 2 * BLOCK_SIZE);
+                /* blkmix(Z, Y) */
+                neoscrypt_blkmix(&Z[0], &Y[0], r, (mixmode | 0x0100));
+            }
+        }
 
-    if(dblmix)
-      /* blkxor(X, Z) */
-      neoscrypt_blkxor(&X[0], &Z[0], r * 2 * BLOCK_SIZE);
+        /* X = SMix(X) */
+        for(i = 0; i < N; i++) {
+            /* blkcpy(V, X) */
+            neoscrypt_blkcpy(&V[i * (32 * r)], &X[0], r * 2 * BLOCK_SIZE);
+            /* blkmix(X, Y) */
+            neoscrypt_blkmix(&X[0], &Y[0], r, mixmode);
+        }
+        for(i = 0; i < N; i++) {
+            /* integerify(X) mod N */
+            j = (32 * r) * (X[16 * (2 * r - 1)] & (N - 1));
+            /* blkxor(X, V) */
+            neoscrypt_blkxor(&X[0], &V[j], r * 2 * BLOCK_SIZE);
+            /* blkmix(X, Y) */
+            neoscrypt_blkmix(&X[0], &Y[0], r, mixmode);
+        }
+
+        if(dblmix)
+          /* blkxor(X, Z) */
+          neoscrypt_blkxor(&X[0], &Z[0], r * 2 * BLOCK_SIZE);
+    }
 
     /* output = KDF(password, X) */
     switch(kdf) {
@@ -3255,9 +3558,72 @@ void neoscrypt_fastkdf_4way(const uchar *password, const uchar *salt,
 
 #ifndef ASM
 uint cpu_vec_exts() {
+    uint exts = 0;
+
+#ifdef NEOSCRYPT_X86_SIMD
+    uint eax, ebx, ecx, edx;
+
+    /* Same bit layout as the assembly version reports;
+     * AVX and above are left out as nothing here uses them */
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        /* MMX (bit 23 of %edx) */
+        if(edx & 0x00800000) exts |= 0x00000001;
+        /* SSE (bit 25 of %edx) */
+        if(edx & 0x02000000) exts |= 0x00000010;
+        /* SSE2 (bit 26 of %edx) */
+        if(edx & 0x04000000) exts |= 0x00000020;
+        /* SSE3 (bit 0 of %ecx) */
+        if(ecx & 0x00000001) exts |= 0x00000040;
+        /* SSSE3 (bit 9 of %ecx) */
+        if(ecx & 0x00000200) exts |= 0x00000080;
+        /* SSE4.1 (bit 19 of %ecx) */
+        if(ecx & 0x00080000) exts |= 0x00000100;
+        /* SSE4.2 (bit 20 of %ecx) */
+        if(ecx & 0x00100000) exts |= 0x00000200;
+    }
+#endif
+
+    return(exts);
+}
+
+/* Selects the fastest mixing kernels the processor supports which
+ * also agree with the portable code; returns their description */
+const char *neoscrypt_autodetect() {
+    const char *name = "standard";
+
+    neoscrypt_salsa_kernel        = neoscrypt_salsa;
+    neoscrypt_chacha_kernel       = neoscrypt_chacha;
+    neoscrypt_chacha_salsa_kernel = neoscrypt_chacha_salsa;
+
+#ifdef NEOSCRYPT_X86_SIMD
+    uint exts = cpu_vec_exts();
+
+    /* SSE2 */
+    if((exts & 0x00000020) &&
+      neoscrypt_kernel_test(neoscrypt_salsa_sse2, neoscrypt_salsa) &&
+      neoscrypt_kernel_test_dbl(neoscrypt_chacha_salsa_sse2)) {
+        neoscrypt_salsa_kernel        = neoscrypt_salsa_sse2;
+        neoscrypt_chacha_salsa_kernel = neoscrypt_chacha_salsa_sse2;
+        name = "sse2";
+
+        /* SSSE3 */
+        if((exts & 0x00000080) &&
+          neoscrypt_kernel_test(neoscrypt_chacha_ssse3, neoscrypt_chacha) &&
+          neoscrypt_kernel_test_dbl(neoscrypt_chacha_salsa_ssse3)) {
+            neoscrypt_chacha_kernel       = neoscrypt_chacha_ssse3;
+            neoscrypt_chacha_salsa_kernel = neoscrypt_chacha_salsa_ssse3;
+            name = "ssse3";
+        }
+    }
+#endif
+
+    return(name);
+}
+#else
+const char *neoscrypt_autodetect() {
 
-    /* No assembly, no extensions */
+    /* Assembly kernels are always used */
 
-    return(0);
+    return("asm");
 }
 #endif
@@ -32,6 +32,8 @@ void neoscrypt_fastkdf_4way(const unsigned char *password,
 
 unsigned int cpu_vec_exts(void);
 
+const char *neoscrypt_autodetect(void);
+
 #if (__cplusplus)
 }
 #else
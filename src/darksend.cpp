@@ -13,12 +13,19 @@
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
+#include "memusage.h"
+#include "random.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilmoneystr.h"
 
+#include <deque>
+
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 int nPrivateSendRounds = DEFAULT_PRIVATESEND_ROUNDS;
 int nPrivateSendAmount = DEFAULT_PRIVATESEND_AMOUNT;
@@ -2295,21 +2302,119 @@ bool CDarkSendSigner::SignMessage(std::string strMessage, std::vector<unsigned c
     return key.SignCompact(ss.GetHash(), vchSigRet);
 }
 
-bool CDarkSendSigner::VerifyMessage(CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string strMessage, std::string& strErrorRet)
+namespace {
+
+class CMessageSignatureCacheHasher
+{
+public:
+    size_t operator()(const uint256& key) const {
+        return key.GetCheapHash();
+    }
+};
+
+/**
+ * Cache of the keys recovered from masternode message signatures. The same
+ * mnb, mnp, mnw, lock vote or governance vote tends to arrive from many peers,
+ * and recovering its signer again each time is expensive. Modelled on the
+ * script signature cache, but storing the recovered key id so that entries
+ * can be filled in before it is known which key a message must be signed by.
+ */
+class CMessageSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || message hash || signature)
+    uint256 nonce;
+    typedef boost::unordered_map<uint256, CKeyID, CMessageSignatureCacheHasher> map_type;
+    map_type mapSigners;
+    boost::shared_mutex cs_sigcache;
+
+public:
+    CMessageSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(vchSig.empty() ? NULL : &vchSig[0], vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, CKeyID& keyIDRet)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        map_type::const_iterator it = mapSigners.find(entry);
+        if(it == mapSigners.end()) return false;
+        keyIDRet = it->second;
+        return true;
+    }
+
+    void Set(const uint256& entry, const CKeyID& keyID)
+    {
+        size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+        if(nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        while(memusage::DynamicUsage(mapSigners) > nMaxCacheSize) {
+            map_type::size_type s = GetRand(mapSigners.bucket_count());
+            map_type::local_iterator it = mapSigners.begin(s);
+            if(it != mapSigners.end(s)) {
+                mapSigners.erase(it->first);
+            }
+        }
+
+        mapSigners.insert(std::make_pair(entry, keyID));
+    }
+};
+
+CMessageSignatureCache& GetMessageSignatureCache()
+{
+    static CMessageSignatureCache messageSignatureCache;
+    return messageSignatureCache;
+}
+
+uint256 GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
+
+/** Recover the signer of a message hash, going through the cache */
+bool RecoverMessageSigner(const uint256& hash, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet)
+{
+    uint256 entry;
+    GetMessageSignatureCache().ComputeEntry(entry, hash, vchSig);
+    if(GetMessageSignatureCache().Get(entry, keyIDRet)) return true;
 
     CPubKey pubkeyFromSig;
-    if(!pubkeyFromSig.RecoverCompact(ss.GetHash(), vchSig)) {
+    if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) return false;
+
+    keyIDRet = pubkeyFromSig.GetID();
+    GetMessageSignatureCache().Set(entry, keyIDRet);
+    return true;
+}
+
+// Message hashes and signatures waiting for ThreadRecoverMessageSigners
+const size_t MAX_PENDING_SIGNERS = 10000;
+boost::mutex cs_pendingSigners;
+boost::condition_variable condPendingSigners;
+std::deque<std::pair<uint256, std::vector<unsigned char> > > dequePendingSigners;
+int nSignerThreads = 0;
+
+}
+
+bool CDarkSendSigner::VerifyMessage(CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string strMessage, std::string& strErrorRet)
+{
+    CKeyID keyIDFromSig;
+    if(!RecoverMessageSigner(GetMessageHash(strMessage), vchSig, keyIDFromSig)) {
         strErrorRet = "Error recovering public key.";
         return false;
     }
 
-    if(pubkeyFromSig.GetID() != pubkey.GetID()) {
+    if(keyIDFromSig != pubkey.GetID()) {
         strErrorRet = strprintf("Keys don't match: pubkey=%s, pubkeyFromSig=%s, strMessage=%s, vchSig=%s",
-                    pubkey.GetID().ToString(), pubkeyFromSig.GetID().ToString(), strMessage,
+                    pubkey.GetID().ToString(), keyIDFromSig.ToString(), strMessage,
                     EncodeBase64(&vchSig[0], vchSig.size()));
         return false;
     }
@@ -2317,6 +2422,19 @@ bool CDarkSendSigner::VerifyMessage(CPubKey pubkey, const std::vector<unsigned c
     return true;
 }
 
+void CDarkSendSigner::RecoverSignersAsync(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& vecMessages)
+{
+    if(vecMessages.empty()) return;
+
+    boost::unique_lock<boost::mutex> lock(cs_pendingSigners);
+    // without signature threads VerifyMessage() simply does the work itself
+    if(nSignerThreads == 0) return;
+    for(size_t i = 0; i < vecMessages.size() && dequePendingSigners.size() < MAX_PENDING_SIGNERS; i++) {
+        dequePendingSigners.push_back(std::make_pair(GetMessageHash(vecMessages[i].first), vecMessages[i].second));
+    }
+    condPendingSigners.notify_all();
+}
+
 bool CDarkSendEntry::AddScriptSig(const CTxIn& txin)
 {
     BOOST_FOREACH(CTxDSIn& txdsin, vecTxDSIn) {
@@ -2461,6 +2579,31 @@ void CDarksendPool::UpdatedBlockTip(const CBlockIndex *pindex)
     }
 }
 
+void ThreadRecoverMessageSigners()
+{
+    RenameThread("neobytes-sigrecover");
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs_pendingSigners);
+        nSignerThreads++;
+    }
+
+    while(true) {
+        std::pair<uint256, std::vector<unsigned char> > pairPending;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_pendingSigners);
+            while(dequePendingSigners.empty())
+                condPendingSigners.wait(lock);
+            pairPending.first = dequePendingSigners.front().first;
+            pairPending.second.swap(dequePendingSigners.front().second);
+            dequePendingSigners.pop_front();
+        }
+        // the result lands in the cache; a bad signature is reported once the message is processed
+        CKeyID keyID;
+        RecoverMessageSigner(pairPending.first, pairPending.second, keyID);
+    }
+}
+
 //TODO: Rename/move to core
 void ThreadCheckDarkSendPool()
 {
@@ -248,6 +248,8 @@ public:
     bool SignMessage(std::string strMessage, std::vector<unsigned char>& vchSigRet, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string strMessage, std::string& strErrorRet);
+    /// Recover the signers of these messages on the signature threads, so that VerifyMessage() finds them cached later
+    void RecoverSignersAsync(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& vecMessages);
 };
 
 /** Used to keep track of current status of mixing pool
@@ -480,5 +482,7 @@ public:
 };
 
 void ThreadCheckDarkSendPool();
+/** Run an instance of the thread recovering signers for CDarkSendSigner::RecoverSignersAsync() */
+void ThreadRecoverMessageSigners();
 
 #endif
@@ -7,11 +7,16 @@
 
 #include "chainparams.h"
 #include "clientversion.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "streams.h"
+#include "sync.h"
 #include "util.h"
 
+#include <map>
+
 #include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
 
 /** 
 *   Generic Dumping and Loading
@@ -77,46 +82,33 @@ private:
         //LOCK(objToLoad.cs);
 
         int64_t nStart = GetTimeMillis();
-        // open input file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "rb");
-        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-        if (filein.IsNull())
+        // map the file rather than reading it, the data is hashed and
+        // deserialized straight from the mapping
+        CFileView view;
+        if (!view.Open(pathDB))
         {
             error("%s: Failed to open file %s", __func__, pathDB.string());
             return FileError;
         }
 
-        // use file size to size memory buffer
-        int fileSize = boost::filesystem::file_size(pathDB);
-        int dataSize = fileSize - sizeof(uint256);
-        // Don't try to resize to a negative number if file is small
-        if (dataSize < 0)
-            dataSize = 0;
-        std::vector<unsigned char> vchData;
-        vchData.resize(dataSize);
-        uint256 hashIn;
-
-        // read data and checksum from file
-        try {
-            filein.read((char *)&vchData[0], dataSize);
-            filein >> hashIn;
-        }
-        catch (std::exception &e) {
-            error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        if (view.size() < sizeof(uint256))
+        {
+            error("%s: Deserialize or I/O error - %s", __func__, "file too small");
             return HashReadError;
         }
-        filein.fclose();
-
-        CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
+        const unsigned char* pdataEnd = view.end() - sizeof(uint256);
+        uint256 hashIn;
+        memcpy(hashIn.begin(), pdataEnd, sizeof(uint256));
 
         // verify stored checksum matches input data
-        uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
+        uint256 hashTmp = Hash(view.begin(), pdataEnd);
         if (hashIn != hashTmp)
         {
             error("%s: Checksum mismatch, data corrupted", __func__);
             return IncorrectHash;
         }
 
+        CMemoryReader ssObj((const char*)view.begin(), (const char*)pdataEnd, SER_DISK, CLIENT_VERSION);
 
         unsigned char pchMsgTmp[4];
         std::string strMagicMessageTmp;
@@ -150,6 +142,7 @@ private:
             error("%s: Deserialize or I/O error - %s", __func__, e.what());
             return IncorrectFormat;
         }
+        view.Close();
 
         LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToLoad.ToString());
@@ -225,5 +218,560 @@ public:
 
 };
 
+/**
+*   Journaled Dumping and Loading
+*   -----------------------------
+*
+*   An append-only log with one record per entry of the large containers of an
+*   object, which lists them in its JournalOp(). Every flush appends only the
+*   entries that changed since the previous one, erase records for the entries
+*   that are gone and a commit marker, so dumping no longer rewrites everything.
+*   Once most of the log consists of superseded records it is rewritten from
+*   scratch.
+*
+*   Layout: magic message, network magic and journal version, followed by
+*   records of [body size][body][Hash(body)], where a body is a record kind
+*   followed by the record key and value. Records following the last commit
+*   marker are what is left of an interrupted flush and get dropped on load.
+*/
+
+enum FlatJournalRecordKind {
+    JOURNAL_RECORD_PUT = 1,
+    JOURNAL_RECORD_ERASE = 2,
+    JOURNAL_RECORD_COMMIT = 3
+};
+
+/** Record size on disk for a body of nBodySize bytes */
+inline int64_t FlatJournalRecordSize(size_t nBodySize)
+{
+    return sizeof(uint32_t) + nBodySize + sizeof(uint256);
+}
+
+/** Latest record written for a key */
+struct CFlatJournalEntry
+{
+    CFlatJournalEntry() : nSize(0), fSeen(false) {}
+
+    uint256 hash;
+    int64_t nSize;
+    bool fSeen;
+};
+
+typedef std::map<std::vector<unsigned char>, CFlatJournalEntry> flat_journal_index_t;
+
+/**
+ * Passed to T::JournalOp() to write the object into the log: records whose
+ * checksum matches the last one written for their key are skipped, unless
+ * the whole log is being rewritten.
+ */
+class CFlatJournalWriter
+{
+private:
+    CAutoFile& fileout;
+    flat_journal_index_t& mapIndex;
+    bool fRewrite;
+    CDataStream ssBody;
+    int64_t nBytesWritten;
+    int64_t nLiveBytes;
+    int nRecordsWritten;
+
+    void WriteRecord(const uint256& hash)
+    {
+        fileout << (uint32_t)ssBody.size();
+        fileout.write(&ssBody[0], ssBody.size());
+        fileout << hash;
+        nBytesWritten += FlatJournalRecordSize(ssBody.size());
+        nRecordsWritten++;
+    }
+
+    template<typename V>
+    void Put(const std::vector<unsigned char>& vchKey, const V& value)
+    {
+        ssBody.clear();
+        ssBody << (unsigned char)JOURNAL_RECORD_PUT << vchKey << value;
+        uint256 hash = Hash(ssBody.begin(), ssBody.end());
+
+        CFlatJournalEntry& entry = mapIndex[vchKey];
+        entry.fSeen = true;
+        if(!fRewrite && entry.nSize != 0 && entry.hash == hash) return;
+
+        entry.hash = hash;
+        entry.nSize = FlatJournalRecordSize(ssBody.size());
+        WriteRecord(hash);
+    }
+
+public:
+    CFlatJournalWriter(CAutoFile& fileoutIn, flat_journal_index_t& mapIndexIn, bool fRewriteIn)
+        : fileout(fileoutIn), mapIndex(mapIndexIn), fRewrite(fRewriteIn),
+          ssBody(SER_DISK, CLIENT_VERSION), nBytesWritten(0), nLiveBytes(0), nRecordsWritten(0)
+    {}
+
+    bool ForRead() const { return false; }
+
+    /// A single record holding obj
+    template<typename V>
+    void Value(unsigned char nTag, const V& obj)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << nTag;
+        Put(std::vector<unsigned char>(ssKey.begin(), ssKey.end()), obj);
+    }
+
+    /// A record for every entry of map
+    template<typename M>
+    void Map(unsigned char nTag, const M& map)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        for(typename M::const_iterator it = map.begin(); it != map.end(); ++it) {
+            ssKey.clear();
+            ssKey << nTag << it->first;
+            Put(std::vector<unsigned char>(ssKey.begin(), ssKey.end()), it->second);
+        }
+    }
+
+    /// Erase whatever was not visited since the last commit, then commit
+    void Commit()
+    {
+        flat_journal_index_t::iterator it = mapIndex.begin();
+        while(it != mapIndex.end()) {
+            if(!it->second.fSeen) {
+                ssBody.clear();
+                ssBody << (unsigned char)JOURNAL_RECORD_ERASE << it->first;
+                WriteRecord(Hash(ssBody.begin(), ssBody.end()));
+                mapIndex.erase(it++);
+                continue;
+            }
+            it->second.fSeen = false;
+            nLiveBytes += it->second.nSize;
+            ++it;
+        }
+        ssBody.clear();
+        ssBody << (unsigned char)JOURNAL_RECORD_COMMIT;
+        WriteRecord(Hash(ssBody.begin(), ssBody.end()));
+    }
+
+    int64_t GetBytesWritten() const { return nBytesWritten; }
+    int64_t GetLiveBytes() const { return nLiveBytes; }
+    int GetRecordsWritten() const { return nRecordsWritten; }
+};
+
+/**
+ * Passed to T::JournalOp() to load the object: the calls made before Commit()
+ * register where records go, Commit() then streams the log into them.
+ */
+class CFlatJournalReader
+{
+private:
+    class CHandler
+    {
+    public:
+        virtual ~CHandler() {}
+        virtual void Put(CMemoryReader& ssKey, CMemoryReader& ssValue) = 0;
+        virtual void Erase(CMemoryReader& ssKey) = 0;
+    };
+
+    template<typename V>
+    class CValueHandler : public CHandler
+    {
+    private:
+        V& obj;
+    public:
+        CValueHandler(V& objIn) : obj(objIn) {}
+        void Put(CMemoryReader& ssKey, CMemoryReader& ssValue) { ssValue >> obj; }
+        void Erase(CMemoryReader& ssKey) {}
+    };
+
+    template<typename M>
+    class CMapHandler : public CHandler
+    {
+    private:
+        M& map;
+    public:
+        CMapHandler(M& mapIn) : map(mapIn) {}
+        void Put(CMemoryReader& ssKey, CMemoryReader& ssValue)
+        {
+            typename M::key_type key;
+            ssKey >> key;
+            // deserialize into a fresh entry rather than over an older one
+            map.erase(key);
+            ssValue >> map[key];
+        }
+        void Erase(CMemoryReader& ssKey)
+        {
+            typename M::key_type key;
+            ssKey >> key;
+            map.erase(key);
+        }
+    };
+
+    const unsigned char* pcur;
+    const unsigned char* pend;
+    flat_journal_index_t& mapIndex;
+    std::map<unsigned char, boost::shared_ptr<CHandler> > mapHandlers;
+    bool fCorrupted;
+    int64_t nLiveBytes;
+
+public:
+    /** Reads the records in [pbegin, pendIn), which must all be complete */
+    CFlatJournalReader(const unsigned char* pbegin, const unsigned char* pendIn, flat_journal_index_t& mapIndexIn)
+        : pcur(pbegin), pend(pendIn), mapIndex(mapIndexIn), fCorrupted(false), nLiveBytes(0)
+    {}
+
+    bool ForRead() const { return true; }
+
+    template<typename V>
+    void Value(unsigned char nTag, V& obj)
+    {
+        mapHandlers[nTag].reset(new CValueHandler<V>(obj));
+    }
+
+    template<typename M>
+    void Map(unsigned char nTag, M& map)
+    {
+        mapHandlers[nTag].reset(new CMapHandler<M>(map));
+    }
+
+    void Commit()
+    {
+        while(pcur < pend) {
+            uint32_t nSize = ReadLE32(pcur);
+            const unsigned char* pbody = pcur + sizeof(uint32_t);
+            uint256 hashIn;
+            memcpy(hashIn.begin(), pbody + nSize, sizeof(uint256));
+            pcur += FlatJournalRecordSize(nSize);
+
+            uint256 hash = Hash(pbody, pbody + nSize);
+            if(hashIn != hash) {
+                fCorrupted = true;
+                throw std::runtime_error("journal record checksum mismatch");
+            }
+
+            CMemoryReader ssBody((const char*)pbody, (const char*)pbody + nSize, SER_DISK, CLIENT_VERSION);
+            unsigned char nKind;
+            ssBody >> nKind;
+            if(nKind == JOURNAL_RECORD_COMMIT) continue;
+            if(nKind != JOURNAL_RECORD_PUT && nKind != JOURNAL_RECORD_ERASE)
+                throw std::runtime_error("unknown journal record kind");
+
+            std::vector<unsigned char> vchKey;
+            ssBody >> vchKey;
+            CMemoryReader ssKey((const char*)begin_ptr(vchKey), (const char*)end_ptr(vchKey), SER_DISK, CLIENT_VERSION);
+            unsigned char nTag;
+            ssKey >> nTag;
+
+            // records of containers this version no longer stores are skipped
+            std::map<unsigned char, boost::shared_ptr<CHandler> >::iterator itHandler = mapHandlers.find(nTag);
+            if(nKind == JOURNAL_RECORD_PUT) {
+                if(itHandler != mapHandlers.end()) itHandler->second->Put(ssKey, ssBody);
+                CFlatJournalEntry& entry = mapIndex[vchKey];
+                entry.hash = hash;
+                entry.nSize = FlatJournalRecordSize(nSize);
+            } else {
+                if(itHandler != mapHandlers.end()) itHandler->second->Erase(ssKey);
+                mapIndex.erase(vchKey);
+            }
+        }
+
+        for(flat_journal_index_t::const_iterator it = mapIndex.begin(); it != mapIndex.end(); ++it)
+            nLiveBytes += it->second.nSize;
+    }
+
+    bool IsCorrupted() const { return fCorrupted; }
+    int64_t GetLiveBytes() const { return nLiveBytes; }
+};
+
+template<typename T>
+class CFlatJournalDB
+{
+private:
+
+    enum ReadResult {
+        Ok,
+        FileError,
+        HashReadError,
+        IncorrectHash,
+        IncorrectMagicMessage,
+        IncorrectMagicNumber,
+        IncorrectFormat
+    };
+
+    static const uint32_t JOURNAL_VERSION = 1;
+    /// Logs smaller than this are never compacted
+    static const int64_t JOURNAL_MIN_COMPACT_SIZE = 1 << 20;
+
+    CCriticalSection cs;
+    std::string strFilename;
+    std::string strLegacyFilename;
+    std::string strMagicMessage;
+    /// Latest record of every key in the log on disk
+    flat_journal_index_t mapIndex;
+    /// Whether the log on disk matches mapIndex, so that it can be appended to
+    bool fAppend;
+    int64_t nHeaderSize;
+    int64_t nFileSize;
+    /// Size the log would shrink to if it was rewritten
+    int64_t nLiveSize;
+
+    boost::filesystem::path GetPath() const { return GetDataDir() / strFilename; }
+
+    void WriteHeader(CAutoFile& fileout)
+    {
+        fileout << strMagicMessage; // specific magic message for this type of object
+        fileout << FLATDATA(Params().MessageStart()); // network specific magic number
+        uint32_t nVersion = JOURNAL_VERSION;
+        fileout << nVersion;
+    }
+
+    /** Returns the end of the last commit marker, walking record headers only */
+    const unsigned char* FindLastCommit(const unsigned char* pbegin, const unsigned char* pend)
+    {
+        const unsigned char* pcur = pbegin;
+        const unsigned char* pcommitted = pbegin;
+        while(pend - pcur >= (int64_t)(sizeof(uint32_t) + 1)) {
+            uint32_t nSize = ReadLE32(pcur);
+            if(nSize == 0 || nSize > MAX_SIZE || FlatJournalRecordSize(nSize) > pend - pcur) break;
+            unsigned char nKind = pcur[sizeof(uint32_t)];
+            pcur += FlatJournalRecordSize(nSize);
+            if(nKind == JOURNAL_RECORD_COMMIT) pcommitted = pcur;
+        }
+        return pcommitted;
+    }
+
+    ReadResult Read(T& objToLoad)
+    {
+        int64_t nStart = GetTimeMillis();
+        boost::filesystem::path pathDB = GetPath();
+
+        // records are checked and deserialized straight from the mapping
+        CFileView view;
+        if (!view.Open(pathDB))
+        {
+            error("%s: Failed to open file %s", __func__, pathDB.string());
+            return FileError;
+        }
+        int64_t nFileSizeIn = view.size();
+
+        CMemoryReader ssHeader((const char*)view.begin(), (const char*)view.end(), SER_DISK, CLIENT_VERSION);
+        unsigned char pchMsgTmp[4];
+        std::string strMagicMessageTmp;
+        uint32_t nVersionTmp;
+        try {
+            ssHeader >> strMagicMessageTmp;
+            ssHeader >> FLATDATA(pchMsgTmp);
+            ssHeader >> nVersionTmp;
+        }
+        catch (std::exception &e) {
+            error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            return HashReadError;
+        }
+
+        if (strMagicMessage != strMagicMessageTmp)
+        {
+            error("%s: Invalid magic message", __func__);
+            return IncorrectMagicMessage;
+        }
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+        {
+            error("%s: Invalid network magic number", __func__);
+            return IncorrectMagicNumber;
+        }
+        if (nVersionTmp != JOURNAL_VERSION)
+        {
+            error("%s: Unknown journal version %u", __func__, nVersionTmp);
+            return IncorrectFormat;
+        }
+
+        const unsigned char* pbegin = view.end() - ssHeader.size();
+        const unsigned char* pcommitted = FindLastCommit(pbegin, view.end());
+        int64_t nBegin = pbegin - view.begin();
+        int64_t nCommitted = pcommitted - view.begin();
+
+        mapIndex.clear();
+        CFlatJournalReader reader(pbegin, pcommitted, mapIndex);
+        try {
+            objToLoad.JournalOp(reader);
+        }
+        catch (std::exception &e) {
+            mapIndex.clear();
+            objToLoad.Clear();
+            error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            return reader.IsCorrupted() ? IncorrectHash : IncorrectFormat;
+        }
+        view.Close();
+
+        if (nCommitted < nFileSizeIn)
+        {
+            LogPrintf("%s: Dropping %d bytes of an interrupted write from %s\n", __func__, nFileSizeIn - nCommitted, strFilename);
+            FILE *fileTrunc = fopen(pathDB.string().c_str(), "r+b");
+            if (!fileTrunc || !TruncateFile(fileTrunc, nCommitted))
+            {
+                if (fileTrunc) fclose(fileTrunc);
+                mapIndex.clear();
+                objToLoad.Clear();
+                error("%s: Failed to truncate file %s", __func__, pathDB.string());
+                return FileError;
+            }
+            fclose(fileTrunc);
+        }
+
+        fAppend = true;
+        nHeaderSize = nBegin;
+        nFileSize = nCommitted;
+        nLiveSize = nHeaderSize + reader.GetLiveBytes();
+
+        LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
+        LogPrintf("     %s\n", objToLoad.ToString());
+        LogPrintf("%s: Cleaning....\n", __func__);
+        objToLoad.CheckAndRemove();
+        LogPrintf("     %s\n", objToLoad.ToString());
+
+        return Ok;
+    }
+
+    /** Write all of objToSave into a fresh log which then replaces the old one */
+    bool Rewrite(T& objToSave)
+    {
+        boost::filesystem::path pathDB = GetPath();
+        boost::filesystem::path pathTmp = pathDB;
+        pathTmp += ".new";
+
+        fAppend = false;
+        mapIndex.clear();
+
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
+
+        CFlatJournalWriter writer(fileout, mapIndex, true);
+        try {
+            WriteHeader(fileout);
+            nHeaderSize = ftell(fileout.Get());
+            objToSave.JournalOp(writer);
+            FileCommit(fileout.Get());
+        }
+        catch (std::exception &e) {
+            mapIndex.clear();
+            return error("%s: Serialize or I/O error - %s", __func__, e.what());
+        }
+        fileout.fclose();
+
+        if (!RenameOver(pathTmp, pathDB))
+        {
+            mapIndex.clear();
+            return error("%s: Rename-into-place failed", __func__);
+        }
+
+        boost::filesystem::path pathLegacy = GetDataDir() / strLegacyFilename;
+        if (boost::filesystem::exists(pathLegacy))
+            boost::filesystem::remove(pathLegacy);
+
+        fAppend = true;
+        nFileSize = nHeaderSize + writer.GetBytesWritten();
+        nLiveSize = nHeaderSize + writer.GetLiveBytes();
+        LogPrint("masternode", "%s: Rewrote %s, %d records, %d bytes\n", __func__, strFilename, writer.GetRecordsWritten(), nFileSize);
+
+        return true;
+    }
+
+    /** Append the entries of objToSave that changed since the last write */
+    bool Append(T& objToSave)
+    {
+        boost::filesystem::path pathDB = GetPath();
+
+        FILE *file = fopen(pathDB.string().c_str(), "ab");
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull())
+        {
+            fAppend = false;
+            return error("%s: Failed to open file %s", __func__, pathDB.string());
+        }
+
+        CFlatJournalWriter writer(fileout, mapIndex, false);
+        try {
+            objToSave.JournalOp(writer);
+            FileCommit(fileout.Get());
+        }
+        catch (std::exception &e) {
+            // the index no longer describes the file, start over next time
+            fAppend = false;
+            return error("%s: Serialize or I/O error - %s", __func__, e.what());
+        }
+        fileout.fclose();
+
+        nFileSize += writer.GetBytesWritten();
+        nLiveSize = nHeaderSize + writer.GetLiveBytes();
+        LogPrint("masternode", "%s: Appended %d records, %d bytes to %s\n", __func__, writer.GetRecordsWritten(), writer.GetBytesWritten(), strFilename);
+
+        return true;
+    }
+
+public:
+    CFlatJournalDB(std::string strFilenameIn, std::string strLegacyFilenameIn, std::string strMagicMessageIn)
+        : strFilename(strFilenameIn),
+          strLegacyFilename(strLegacyFilenameIn),
+          strMagicMessage(strMagicMessageIn),
+          fAppend(false),
+          nHeaderSize(0),
+          nFileSize(0),
+          nLiveSize(0)
+    {}
+
+    bool Load(T& objToLoad)
+    {
+        LOCK(cs);
+
+        if (!boost::filesystem::exists(GetPath()) && boost::filesystem::exists(GetDataDir() / strLegacyFilename))
+        {
+            // the log gets created from scratch on the first flush
+            CFlatDB<T> flatdb(strLegacyFilename, strMagicMessage);
+            return flatdb.Load(objToLoad);
+        }
+
+        LogPrintf("Reading info from %s...\n", strFilename);
+        ReadResult readResult = Read(objToLoad);
+        if (readResult == FileError)
+            LogPrintf("Missing file %s, will try to recreate\n", strFilename);
+        else if (readResult != Ok)
+        {
+            LogPrintf("Error reading %s: ", strFilename);
+            if(readResult == IncorrectFormat)
+            {
+                LogPrintf("%s: Magic is ok but data has invalid format, will try to recreate\n", __func__);
+            }
+            else {
+                LogPrintf("%s: File format is unknown or invalid, please fix it manually\n", __func__);
+                // program should exit with an error
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** Bring the log on disk up to date with objToSave */
+    bool Flush(T& objToSave)
+    {
+        LOCK(cs);
+
+        if (!fAppend || (nFileSize > JOURNAL_MIN_COMPACT_SIZE && nFileSize > 2 * nLiveSize))
+            return Rewrite(objToSave);
+        return Append(objToSave);
+    }
+
+    bool Dump(T& objToSave)
+    {
+        int64_t nStart = GetTimeMillis();
+
+        LogPrintf("Writting info to %s...\n", strFilename);
+        if (!Flush(objToSave))
+            return false;
+        LogPrintf("%s dump finished  %dms\n", strFilename, GetTimeMillis() - nStart);
+        LogPrintf("     %s\n", objToSave.ToString());
+
+        return true;
+    }
+
+};
+
 
-#endif
\ No newline at end of file
+#endif
@@ -35,6 +35,7 @@ CGovernanceObject::CGovernanceObject()
   fExpired(false),
   fUnparsable(false),
   mapCurrentMNVotes(),
+  mapVoteTally(),
   mapOrphanVotes(),
   fileVotes()
 {
@@ -63,6 +64,7 @@ CGovernanceObject::CGovernanceObject(uint256 nHashParentIn, int nRevisionIn, int
   fExpired(false),
   fUnparsable(false),
   mapCurrentMNVotes(),
+  mapVoteTally(),
   mapOrphanVotes(),
   fileVotes()
 {
@@ -91,6 +93,7 @@ CGovernanceObject::CGovernanceObject(const CGovernanceObject& other)
   fExpired(other.fExpired),
   fUnparsable(other.fUnparsable),
   mapCurrentMNVotes(other.mapCurrentMNVotes),
+  mapVoteTally(other.mapVoteTally),
   mapOrphanVotes(other.mapOrphanVotes),
   fileVotes(other.fileVotes)
 {}
@@ -188,7 +191,9 @@ bool CGovernanceObject::ProcessVote(CNode* pfrom,
         exception = CGovernanceException(ostr.str(), GOVERNANCE_EXCEPTION_PERMANENT_ERROR);
         return false;
     }
+    UpdateVoteTally(int(eSignal), voteInstance.eOutcome, -1);
     voteInstance = vote_instance_t(vote.GetOutcome(), nVoteTimeUpdate, vote.GetTimestamp());
+    UpdateVoteTally(int(eSignal), voteInstance.eOutcome, 1);
     if(!fileVotes.HasVote(vote.GetHash())) {
         fileVotes.AddVote(vote);
     }
@@ -209,6 +214,7 @@ void CGovernanceObject::RebuildVoteMap()
         }
     }
     mapCurrentMNVotes = mapMNVotesNew;
+    RebuildVoteTally();
 }
 
 void CGovernanceObject::ClearMasternodeVotes()
@@ -228,6 +234,7 @@ void CGovernanceObject::ClearMasternodeVotes()
         }
 
         if(fRemove) {
+            UpdateVoteTally(it->second, -1);
             mapCurrentMNVotes.erase(it++);
         }
         else {
@@ -605,19 +612,39 @@ bool CGovernanceObject::IsCollateralValid(std::string& strError)
 
 int CGovernanceObject::CountMatchingVotes(vote_signal_enum_t eVoteSignalIn, vote_outcome_enum_t eVoteOutcomeIn) const
 {
-    int nCount = 0;
+    vote_tally_m_cit it = mapVoteTally.find(std::make_pair(int(eVoteSignalIn), int(eVoteOutcomeIn)));
+    if(it == mapVoteTally.end()) {
+        return 0;
+    }
+    return it->second;
+}
+
+void CGovernanceObject::UpdateVoteTally(int nSignal, vote_outcome_enum_t eOutcome, int nDelta)
+{
+    if(eOutcome == VOTE_OUTCOME_NONE) {
+        return;
+    }
+    std::pair<int, int> key = std::make_pair(nSignal, int(eOutcome));
+    int& nCount = mapVoteTally[key];
+    nCount += nDelta;
+    if(nCount == 0) {
+        mapVoteTally.erase(key);
+    }
+}
+
+void CGovernanceObject::UpdateVoteTally(const vote_rec_t& recVote, int nDelta)
+{
+    for(vote_instance_m_cit it = recVote.mapInstances.begin(); it != recVote.mapInstances.end(); ++it) {
+        UpdateVoteTally(it->first, it->second.eOutcome, nDelta);
+    }
+}
+
+void CGovernanceObject::RebuildVoteTally()
+{
+    mapVoteTally.clear();
     for(vote_m_cit it = mapCurrentMNVotes.begin(); it != mapCurrentMNVotes.end(); ++it) {
-        const vote_rec_t& recVote = it->second;
-        vote_instance_m_cit it2 = recVote.mapInstances.find(eVoteSignalIn);
-        if(it2 == recVote.mapInstances.end()) {
-            continue;
-        }
-        const vote_instance_t& voteInstance = it2->second;
-        if(voteInstance.eOutcome == eVoteOutcomeIn) {
-            ++nCount;
-        }
+        UpdateVoteTally(it->second, 1);
     }
-    return nCount;
 }
 
 /**
@@ -27,6 +27,7 @@ class CGovernanceVote;
 static const int MAX_GOVERNANCE_OBJECT_DATA_SIZE = 16 * 1024;
 static const int MIN_GOVERNANCE_PEER_PROTO_VERSION = 70206;
 static const int GOVERNANCE_FILTER_PROTO_VERSION = 70206;
+static const int GOVERNANCE_VOTE_SYNC_PROTO_VERSION = 70207;
 
 static const double GOVERNANCE_FILTER_FP_RATE = 0.001;
 
@@ -124,6 +125,11 @@ public: // Types
 
     typedef CacheMultiMap<CTxIn, vote_time_pair_t> vote_mcache_t;
 
+    /// (signal, outcome) -> number of masternodes whose current vote it is
+    typedef std::map<std::pair<int, int>, int> vote_tally_m_t;
+
+    typedef vote_tally_m_t::const_iterator vote_tally_m_cit;
+
 private:
     /// critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -184,6 +190,9 @@ private:
 
     vote_m_t mapCurrentMNVotes;
 
+    /// Running totals of mapCurrentMNVotes, kept in step with it
+    vote_tally_m_t mapVoteTally;
+
     /// Limited map of votes orphaned by MN
     vote_mcache_t mapOrphanVotes;
 
@@ -323,6 +332,9 @@ public:
             READWRITE(nDeletionTime);
             READWRITE(fExpired);
             READWRITE(mapCurrentMNVotes);
+            if(ser_action.ForRead()) {
+                RebuildVoteTally();
+            }
             READWRITE(fileVotes);
             LogPrint("gobject", "CGovernanceObject::SerializationOp hash = %s, vote count = %d\n", GetHash().ToString(), fileVotes.GetVoteCount());
         }
@@ -339,6 +351,13 @@ public:
 private:
     // FUNCTIONS FOR DEALING WITH DATA STRING
     void LoadData();
+
+    /// Add nDelta to the tally of every signal in recVote
+    void UpdateVoteTally(const vote_rec_t& recVote, int nDelta);
+
+    void UpdateVoteTally(int nSignal, vote_outcome_enum_t eOutcome, int nDelta);
+
+    void RebuildVoteTally();
     void GetData(UniValue& objResult);
 
     bool ProcessVote(CNode* pfrom,
@@ -120,6 +120,10 @@ public:
 
     void SetSignature(const std::vector<unsigned char>& vchSigIn) { vchSig = vchSigIn; }
 
+    const std::vector<unsigned char>& GetSignature() const { return vchSig; }
+
+    /// The message covered by vchSig
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(bool fSignatureCheck) const;
     void Relay() const;
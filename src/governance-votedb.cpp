@@ -8,13 +8,15 @@
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile()
     : nMemoryVotes(0),
       listVotes(),
-      mapVoteIndex()
+      mapVoteIndex(),
+      mapMasternodeVotes()
 {}
 
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile(const CGovernanceObjectVoteFile& other)
     : nMemoryVotes(other.nMemoryVotes),
       listVotes(other.listVotes),
-      mapVoteIndex()
+      mapVoteIndex(),
+      mapMasternodeVotes()
 {
     RebuildIndex();
 }
@@ -23,6 +25,7 @@ void CGovernanceObjectVoteFile::AddVote(const CGovernanceVote& vote)
 {
     listVotes.push_front(vote);
     mapVoteIndex[vote.GetHash()] = listVotes.begin();
+    mapMasternodeVotes.insert(vote_mn_m_t::value_type(vote.GetVinMasternode().prevout, listVotes.begin()));
     ++nMemoryVotes;
 }
 
@@ -56,12 +59,15 @@ std::vector<CGovernanceVote> CGovernanceObjectVoteFile::GetVotes() const
 
 void CGovernanceObjectVoteFile::RemoveVotesFromMasternode(const CTxIn& vinMasternode)
 {
-    vote_l_it it = listVotes.begin();
-    while(it != listVotes.end()) {
-        if(it->GetVinMasternode() == vinMasternode) {
+    std::pair<vote_mn_m_it, vote_mn_m_it> range = mapMasternodeVotes.equal_range(vinMasternode.prevout);
+    vote_mn_m_it it = range.first;
+    while(it != range.second) {
+        vote_l_it itVote = it->second;
+        if(itVote->GetVinMasternode() == vinMasternode) {
             --nMemoryVotes;
-            mapVoteIndex.erase(it->GetHash());
-            listVotes.erase(it++);
+            mapVoteIndex.erase(itVote->GetHash());
+            listVotes.erase(itVote);
+            mapMasternodeVotes.erase(it++);
         }
         else {
             ++it;
@@ -80,6 +86,7 @@ CGovernanceObjectVoteFile& CGovernanceObjectVoteFile::operator=(const CGovernanc
 void CGovernanceObjectVoteFile::RebuildIndex()
 {
     mapVoteIndex.clear();
+    mapMasternodeVotes.clear();
     nMemoryVotes = 0;
     vote_l_it it = listVotes.begin();
     while(it != listVotes.end()) {
@@ -87,6 +94,7 @@ void CGovernanceObjectVoteFile::RebuildIndex()
         uint256 nHash = vote.GetHash();
         if(mapVoteIndex.find(nHash) == mapVoteIndex.end()) {
             mapVoteIndex[nHash] = it;
+            mapMasternodeVotes.insert(vote_mn_m_t::value_type(vote.GetVinMasternode().prevout, it));
             ++nMemoryVotes;
             ++it;
         }
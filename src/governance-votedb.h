@@ -35,6 +35,12 @@ public: // Types
 
     typedef vote_m_t::const_iterator vote_m_cit;
 
+    typedef std::multimap<COutPoint,vote_l_it> vote_mn_m_t;
+
+    typedef vote_mn_m_t::iterator vote_mn_m_it;
+
+    typedef vote_mn_m_t::const_iterator vote_mn_m_cit;
+
 private:
     static const int MAX_MEMORY_VOTES = -1;
 
@@ -44,6 +50,9 @@ private:
 
     vote_m_t mapVoteIndex;
 
+    /// Votes by masternode collateral outpoint
+    vote_mn_m_t mapMasternodeVotes;
+
 public:
     CGovernanceObjectVoteFile();
 
@@ -70,6 +79,20 @@ public:
 
     std::vector<CGovernanceVote> GetVotes() const;
 
+    /**
+     * Iterate over all votes in place, newest first
+     */
+    vote_l_cit begin() const { return listVotes.begin(); }
+
+    vote_l_cit end() const { return listVotes.end(); }
+
+    /**
+     * Range of the votes of a single masternode, each entry pointing into the vote list
+     */
+    std::pair<vote_mn_m_cit, vote_mn_m_cit> GetMasternodeVotes(const COutPoint& outpointMasternode) const {
+        return mapMasternodeVotes.equal_range(outpointMasternode);
+    }
+
     CGovernanceObjectVoteFile& operator=(const CGovernanceObjectVoteFile& other);
 
     void RemoveVotesFromMasternode(const CTxIn& vinMasternode);
@@ -147,6 +147,28 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
 
     }
 
+    // ANOTHER USER IS ASKING US FOR THE VOTES OF SEVERAL OBJECTS AT ONCE
+    else if (strCommand == NetMsgType::MNGOVERNANCEVOTESYNC)
+    {
+        // Same as above, finish our own sync first
+        if (!masternodeSync.IsSynced()) return;
+
+        std::vector<uint256> vecHashes;
+        int64_t nMinTime;
+        CBloomFilter filter;
+
+        vRecv >> vecHashes >> nMinTime >> filter;
+        filter.UpdateEmptyFull();
+
+        if(vecHashes.size() > MAX_GOVERNANCE_VOTE_SYNC_OBJECTS) {
+            LogPrint("gobject", "MNGOVERNANCEVOTESYNC -- too many objects requested: %d, peer=%d\n", vecHashes.size(), pfrom->id);
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+
+        SyncVotes(pfrom, vecHashes, nMinTime, filter);
+    }
+
     // A NEW GOVERNANCE OBJECT HAS ARRIVED
     else if (strCommand == NetMsgType::MNGOVERNANCEOBJECT)
 
@@ -169,7 +191,7 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
         uint256 nHash = govobj.GetHash();
         std::string strHash = nHash.ToString();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         LogPrint("gobject", "MNGOVERNANCEOBJECT -- Received object: %s\n", strHash);
 
@@ -260,7 +282,7 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
         uint256 nHash = vote.GetHash();
         std::string strHash = nHash.ToString();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         if(!AcceptVoteMessage(nHash)) {
             LogPrint("gobject", "MNGOVERNANCEOBJECTVOTE -- Received unrequested vote object: %s, hash: %s, peer = %d\n",
@@ -283,6 +305,88 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
         }
 
     }
+
+    // A BATCH OF VOTES FROM A VOTE SYNC WE ASKED FOR HAS ARRIVED
+    else if (strCommand == NetMsgType::MNGOVERNANCEVOTES)
+    {
+        // Ignore such messages until masternode list is synced
+        if(!masternodeSync.IsMasternodeListSynced()) {
+            LogPrint("gobject", "MNGOVERNANCEVOTES -- masternode list not synced\n");
+            return;
+        }
+
+        std::vector<CGovernanceVote> vecVotes;
+        std::vector<uint256> vecCompleted;
+
+        vRecv >> vecVotes >> vecCompleted;
+
+        if(vecVotes.size() > MAX_GOVERNANCE_VOTE_SYNC_VOTES || vecCompleted.size() > MAX_GOVERNANCE_VOTE_SYNC_OBJECTS) {
+            LogPrint("gobject", "MNGOVERNANCEVOTES -- too many votes: %d, objects: %d, peer=%d\n", vecVotes.size(), vecCompleted.size(), pfrom->id);
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+
+        LogPrint("gobject", "MNGOVERNANCEVOTES -- Received %d votes, %d objects completed, peer=%d\n", vecVotes.size(), vecCompleted.size(), pfrom->id);
+
+        LOCK2(cs_main, cs);
+
+        vote_sync_m_it itRequest = mapVoteSyncRequests.find(pfrom->id);
+        if(itRequest == mapVoteSyncRequests.end()) {
+            LogPrint("gobject", "MNGOVERNANCEVOTES -- Received unrequested votes, peer=%d\n", pfrom->id);
+            return;
+        }
+        hash_time_m_t& mapRequested = itRequest->second;
+
+        // Signers of the whole batch were handed to the recovery threads when the
+        // message arrived (see PrefetchMessageSigners), so this mostly hits the cache
+        int nVotesAccepted = 0;
+        for(size_t i = 0; i < vecVotes.size(); ++i) {
+            const CGovernanceVote& vote = vecVotes[i];
+            if(!mapRequested.count(vote.GetParentHash())) {
+                LogPrint("gobject", "MNGOVERNANCEVOTES -- Received vote for unrequested object: %s, peer=%d\n",
+                          vote.GetParentHash().ToString(), pfrom->id);
+                continue;
+            }
+            CGovernanceException exception;
+            if(ProcessVote(pfrom, vote, exception)) {
+                ++nVotesAccepted;
+                // syncing peers get these in their own vote sync
+                if(masternodeSync.IsSynced()) {
+                    vote.Relay();
+                }
+            }
+            else {
+                LogPrint("gobject", "MNGOVERNANCEVOTES -- Rejected vote, error = %s\n", exception.what());
+                if((exception.GetNodePenalty() != 0) && masternodeSync.IsSynced()) {
+                    Misbehaving(pfrom->GetId(), exception.GetNodePenalty());
+                }
+            }
+        }
+
+        // The peer sent everything it had for these, later syncs only need newer votes
+        for(size_t i = 0; i < vecCompleted.size(); ++i) {
+            hash_time_m_it it = mapRequested.find(vecCompleted[i]);
+            if(it == mapRequested.end()) {
+                continue;
+            }
+            int64_t nWatermark = it->second - GOVERNANCE_VOTE_SYNC_WATERMARK_SLACK;
+            hash_time_m_it itWatermark = mapVoteSyncWatermarks.find(it->first);
+            if(itWatermark == mapVoteSyncWatermarks.end()) {
+                mapVoteSyncWatermarks.insert(std::make_pair(it->first, nWatermark));
+            }
+            else {
+                itWatermark->second = std::max(itWatermark->second, nWatermark);
+            }
+            mapRequested.erase(it);
+        }
+        if(mapRequested.empty()) {
+            mapVoteSyncRequests.erase(itRequest);
+        }
+
+        if(nVotesAccepted > 0) {
+            masternodeSync.AddedGovernanceItem();
+        }
+    }
 }
 
 void CGovernanceManager::CheckOrphanVotes(CGovernanceObject& govobj, CGovernanceException& exception)
@@ -459,6 +563,26 @@ void CGovernanceManager::UpdateCachesAndClean()
         }
     }
 
+    // Forget vote sync requests which peers never answered
+    vote_sync_m_it itRequest = mapVoteSyncRequests.begin();
+    while(itRequest != mapVoteSyncRequests.end()) {
+        hash_time_m_it it = itRequest->second.begin();
+        while(it != itRequest->second.end()) {
+            if(it->second + GOVERNANCE_VOTE_SYNC_TIMEOUT < nNow) {
+                itRequest->second.erase(it++);
+            }
+            else {
+                ++it;
+            }
+        }
+        if(itRequest->second.empty()) {
+            mapVoteSyncRequests.erase(itRequest++);
+        }
+        else {
+            ++itRequest;
+        }
+    }
+
     for(size_t i = 0; i < vecDirtyHashes.size(); ++i) {
         object_m_it it = mapObjects.find(vecDirtyHashes[i]);
         if(it == mapObjects.end()) {
@@ -536,6 +660,7 @@ void CGovernanceManager::UpdateCachesAndClean()
             if(pObj->nObjectType == GOVERNANCE_OBJECT_WATCHDOG) {
                 mapWatchdogObjects.erase(it->first);
             }
+            mapVoteSyncWatermarks.erase(it->first);
             mapObjects.erase(it++);
         } else {
             ++it;
@@ -579,29 +704,31 @@ std::vector<CGovernanceVote> CGovernanceManager::GetCurrentVotes(const uint256&
     if(it == mapObjects.end()) return vecResult;
     CGovernanceObject& govobj = it->second;
 
-    // Compile a list of Masternode collateral outpoints for which to get votes
-    std::vector<CTxIn> vecMNTxIn;
-    if (mnCollateralOutpointFilter == CTxIn()) {
-        std::vector<CMasternode> mnlist = mnodeman.GetFullMasternodeVector();
-        for (std::vector<CMasternode>::iterator it = mnlist.begin(); it != mnlist.end(); ++it)
-        {
-            vecMNTxIn.push_back(it->vin);
-        }
+    // Masternode indexes in the vote records must be current before mapping them back
+    if(mnodeman.GetIndexRebuiltFlag()) {
+        RebuildVoteMaps();
     }
-    else {
-        vecMNTxIn.push_back(mnCollateralOutpointFilter);
+
+    // Visit only the masternodes which voted, or just the requested one
+    CGovernanceObject::vote_m_cit itRecord = govobj.mapCurrentMNVotes.begin();
+    CGovernanceObject::vote_m_cit itRecordEnd = govobj.mapCurrentMNVotes.end();
+    if (mnCollateralOutpointFilter != CTxIn()) {
+        itRecord = govobj.mapCurrentMNVotes.find(mnodeman.GetMasternodeIndex(mnCollateralOutpointFilter));
+        if (itRecord == itRecordEnd) return vecResult;
+        itRecordEnd = itRecord;
+        ++itRecordEnd;
     }
 
-    // Loop thru each MN collateral outpoint and get the votes for the `nParentHash` governance object
-    for (std::vector<CTxIn>::iterator it = vecMNTxIn.begin(); it != vecMNTxIn.end(); ++it)
+    for (; itRecord != itRecordEnd; ++itRecord)
     {
-        CTxIn &mnCollateralOutpoint = *it;
-
-        // get a vote_rec_t from the govobj
-        vote_rec_t voteRecord;
-        if (!govobj.GetCurrentMNVotes(mnCollateralOutpoint, voteRecord)) continue;
-
-        for (vote_instance_m_it it3 = voteRecord.mapInstances.begin(); it3 != voteRecord.mapInstances.end(); ++it3) {
+        CTxIn mnCollateralOutpoint;
+        bool fIndexRebuilt = false;
+        if (!mnodeman.Get(itRecord->first, mnCollateralOutpoint, fIndexRebuilt)) continue;
+        // without a filter, only report masternodes still in the list
+        if (mnCollateralOutpointFilter == CTxIn() && !mnodeman.Has(mnCollateralOutpoint)) continue;
+
+        const vote_rec_t& voteRecord = itRecord->second;
+        for (vote_instance_m_cit it3 = voteRecord.mapInstances.begin(); it3 != voteRecord.mapInstances.end(); ++it3) {
             int signal = (it3->first);
             int outcome = ((it3->second).eOutcome);
             int64_t nCreationTime = ((it3->second).nCreationTime);
@@ -798,15 +925,16 @@ void CGovernanceManager::Sync(CNode* pfrom, const uint256& nProp, const CBloomFi
             pfrom->PushInventory(CInv(MSG_GOVERNANCE_OBJECT, it->first));
             ++nObjCount;
 
-            std::vector<CGovernanceVote> vecVotes = govobj.GetVoteFile().GetVotes();
-            for(size_t i = 0; i < vecVotes.size(); ++i) {
-                if(!vecVotes[i].IsValid(true)) {
+            const CGovernanceObjectVoteFile& fileVotes = govobj.GetVoteFile();
+            for(CGovernanceObjectVoteFile::vote_l_cit itVote = fileVotes.begin(); itVote != fileVotes.end(); ++itVote) {
+                uint256 nVoteHash = itVote->GetHash();
+                if(filter.contains(nVoteHash)) {
                     continue;
                 }
-                if(filter.contains(vecVotes[i].GetHash())) {
+                if(!itVote->IsValid(true)) {
                     continue;
                 }
-                pfrom->PushInventory(CInv(MSG_GOVERNANCE_OBJECT_VOTE, vecVotes[i].GetHash()));
+                pfrom->PushInventory(CInv(MSG_GOVERNANCE_OBJECT_VOTE, nVoteHash));
                 ++nVoteCount;
             }
         }
@@ -817,6 +945,57 @@ void CGovernanceManager::Sync(CNode* pfrom, const uint256& nProp, const CBloomFi
     LogPrintf("CGovernanceManager::Sync -- sent %d objects and %d votes to peer=%d\n", nObjCount, nVoteCount, pfrom->id);
 }
 
+void CGovernanceManager::SyncVotes(CNode* pfrom, const std::vector<uint256>& vecHashes, int64_t nMinTime, const CBloomFilter& filter)
+{
+    // do not provide any data until our node is synced
+    if(fMasterNode && !masternodeSync.IsSynced()) return;
+
+    int nVoteCount = 0;
+    std::vector<CGovernanceVote> vecVotes;
+    std::vector<uint256> vecCompleted;
+
+    LogPrint("gobject", "CGovernanceManager::SyncVotes -- syncing votes for %d objects, nMinTime = %d, peer=%d\n", vecHashes.size(), nMinTime, pfrom->id);
+
+    {
+        LOCK2(cs_main, cs);
+
+        for(size_t i = 0; i < vecHashes.size(); ++i) {
+            object_m_it it = mapObjects.find(vecHashes[i]);
+            if(it != mapObjects.end() && !it->second.IsSetCachedDelete() && !it->second.IsSetExpired()) {
+                const CGovernanceObjectVoteFile& fileVotes = it->second.GetVoteFile();
+                for(CGovernanceObjectVoteFile::vote_l_cit itVote = fileVotes.begin(); itVote != fileVotes.end(); ++itVote) {
+                    if(itVote->GetTimestamp() < nMinTime) {
+                        continue;
+                    }
+                    if(filter.contains(itVote->GetHash())) {
+                        continue;
+                    }
+                    if(!itVote->IsValid(true)) {
+                        continue;
+                    }
+                    vecVotes.push_back(*itVote);
+                    ++nVoteCount;
+                    // send full batches right away, the peer can verify them while we collect the rest
+                    if(vecVotes.size() >= MAX_GOVERNANCE_VOTE_SYNC_VOTES) {
+                        pfrom->PushMessage(NetMsgType::MNGOVERNANCEVOTES, vecVotes, vecCompleted);
+                        vecVotes.clear();
+                        vecCompleted.clear();
+                    }
+                }
+            }
+            // unknown and deleted objects are done too, there is nothing to wait for
+            vecCompleted.push_back(vecHashes[i]);
+        }
+
+        if(!vecVotes.empty() || !vecCompleted.empty()) {
+            pfrom->PushMessage(NetMsgType::MNGOVERNANCEVOTES, vecVotes, vecCompleted);
+        }
+    }
+
+    pfrom->PushMessage(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_GOVOBJ_VOTE, nVoteCount);
+    LogPrintf("CGovernanceManager::SyncVotes -- sent %d votes for %d objects to peer=%d\n", nVoteCount, vecHashes.size(), pfrom->id);
+}
+
 bool CGovernanceManager::MasternodeRateCheck(const CGovernanceObject& govobj, update_mode_enum_t eUpdateLast)
 {
     bool fRateCheckBypassed = false;
@@ -1063,9 +1242,9 @@ void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nH
 
         if(pObj) {
             filter = CBloomFilter(Params().GetConsensus().nGovernanceFilterElements, GOVERNANCE_FILTER_FP_RATE, GetRandInt(999999), BLOOM_UPDATE_ALL);
-            std::vector<CGovernanceVote> vecVotes = pObj->GetVoteFile().GetVotes();
-            for(size_t i = 0; i < vecVotes.size(); ++i) {
-                filter.insert(vecVotes[i].GetHash());
+            const CGovernanceObjectVoteFile& fileVotes = pObj->GetVoteFile();
+            for(CGovernanceObjectVoteFile::vote_l_cit itVote = fileVotes.begin(); itVote != fileVotes.end(); ++itVote) {
+                filter.insert(itVote->GetHash());
             }
         }
     }
@@ -1073,6 +1252,38 @@ void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nH
     pfrom->PushMessage(NetMsgType::MNGOVERNANCESYNC, nHash, filter);
 }
 
+void CGovernanceManager::RequestGovernanceVoteSync(CNode* pfrom, const std::vector<uint256>& vecHashes)
+{
+    LOCK(cs);
+
+    LogPrint("gobject", "CGovernanceManager::RequestGovernanceVoteSync -- %d objects (peer=%d)\n", vecHashes.size(), pfrom->GetId());
+
+    // only ask for votes newer than what every one of these objects is already synced up to
+    int64_t nNow = GetAdjustedTime();
+    int64_t nMinTime = std::numeric_limits<int64_t>::max();
+    for(size_t i = 0; i < vecHashes.size(); ++i) {
+        hash_time_m_cit it = mapVoteSyncWatermarks.find(vecHashes[i]);
+        nMinTime = std::min(nMinTime, it == mapVoteSyncWatermarks.end() ? 0 : it->second);
+        mapVoteSyncRequests[pfrom->GetId()][vecHashes[i]] = nNow;
+    }
+
+    CBloomFilter filter(Params().GetConsensus().nGovernanceFilterElements, GOVERNANCE_FILTER_FP_RATE, GetRandInt(999999), BLOOM_UPDATE_ALL);
+    for(size_t i = 0; i < vecHashes.size(); ++i) {
+        CGovernanceObject* pObj = FindGovernanceObject(vecHashes[i]);
+        if(!pObj) {
+            continue;
+        }
+        const CGovernanceObjectVoteFile& fileVotes = pObj->GetVoteFile();
+        for(CGovernanceObjectVoteFile::vote_l_cit itVote = fileVotes.begin(); itVote != fileVotes.end(); ++itVote) {
+            if(itVote->GetTimestamp() >= nMinTime) {
+                filter.insert(itVote->GetHash());
+            }
+        }
+    }
+
+    pfrom->PushMessage(NetMsgType::MNGOVERNANCEVOTESYNC, vecHashes, nMinTime, filter);
+}
+
 int CGovernanceManager::RequestGovernanceObjectVotes(CNode* pnode)
 {
     if(pnode->nVersion < MIN_GOVERNANCE_PEER_PROTO_VERSION) return -3;
@@ -1138,7 +1349,64 @@ int CGovernanceManager::RequestGovernanceObjectVotes(const std::vector<CNode*>&
     std::random_shuffle(vpGovObjsTriggersTmp.begin(), vpGovObjsTriggersTmp.end(), insecureRand);
     std::random_shuffle(vpGovObjsTmp.begin(), vpGovObjsTmp.end(), insecureRand);
 
-    for (int i = 0; i < nMaxObjRequestsPerNode; ++i) {
+    // Peers supporting batched vote sync get the votes of many objects per request,
+    // the rest are asked one object at a time below
+    std::vector<CNode*> vNodesLegacy;
+    hash_s_t setAskedBatch;
+    {
+        LOCK(cs);
+
+        // ask for triggers first, in the same order as below
+        std::vector<CGovernanceObject*> vpGovObjsBatch(vpGovObjsTriggersTmp.rbegin(), vpGovObjsTriggersTmp.rend());
+        vpGovObjsBatch.insert(vpGovObjsBatch.end(), vpGovObjsTmp.rbegin(), vpGovObjsTmp.rend());
+
+        BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+            if(pnode->nVersion < GOVERNANCE_VOTE_SYNC_PROTO_VERSION) {
+                vNodesLegacy.push_back(pnode);
+                continue;
+            }
+            // same peer selection as below
+            if(pnode->fMasternode || (fMasterNode && pnode->fInbound)) continue;
+
+            std::vector<uint256> vecHashes;
+            int nBatchVotes = 0;
+            for(size_t i = 0; i < vpGovObjsBatch.size() && vecHashes.size() < MAX_GOVERNANCE_VOTE_SYNC_OBJECTS; ++i) {
+                uint256 nHashGovobj = vpGovObjsBatch[i]->GetHash();
+                if(mapAskedRecently[nHashGovobj].size() >= nPeersPerHashMax) continue;
+                // to early to ask the same node
+                if(mapAskedRecently[nHashGovobj].count(pnode->addr)) {
+                    setAskedBatch.insert(nHashGovobj);
+                    continue;
+                }
+                // keep the filter of the votes we already have within its capacity
+                int nVotes = vpGovObjsBatch[i]->GetVoteFile().GetVoteCount();
+                if(!vecHashes.empty() && nBatchVotes + nVotes > Params().GetConsensus().nGovernanceFilterElements) break;
+                setAskedBatch.insert(nHashGovobj);
+                vecHashes.push_back(nHashGovobj);
+                nBatchVotes += nVotes;
+                mapAskedRecently[nHashGovobj][pnode->addr] = nNow + nTimeout;
+            }
+            if(!vecHashes.empty()) {
+                RequestGovernanceVoteSync(pnode, vecHashes);
+            }
+        }
+
+        // objects handled above count as asked, just like the ones popped below
+        for(int nList = 0; nList < 2 && !setAskedBatch.empty(); ++nList) {
+            std::vector<CGovernanceObject*>& vpGovObjs = nList == 0 ? vpGovObjsTriggersTmp : vpGovObjsTmp;
+            std::vector<CGovernanceObject*>::iterator it = vpGovObjs.begin();
+            while(it != vpGovObjs.end()) {
+                if(setAskedBatch.count((*it)->GetHash())) {
+                    it = vpGovObjs.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < nMaxObjRequestsPerNode && !vNodesLegacy.empty(); ++i) {
         uint256 nHashGovobj;
 
         // ask for triggers first
@@ -1149,7 +1417,7 @@ int CGovernanceManager::RequestGovernanceObjectVotes(const std::vector<CNode*>&
             nHashGovobj = vpGovObjsTmp.back()->GetHash();
         }
         bool fAsked = false;
-        BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+        BOOST_FOREACH(CNode* pnode, vNodesLegacy) {
             // Only use reqular peers, don't try to ask from outbound "masternode" connections -
             // they stay connected for a short period of time and it's possible that we won't get everything we should.
             // Only use outbound connections - inbound connection could be a "masternode" connection
@@ -1212,9 +1480,9 @@ void CGovernanceManager::RebuildIndexes()
     mapVoteToObject.Clear();
     for(object_m_it it = mapObjects.begin(); it != mapObjects.end(); ++it) {
         CGovernanceObject& govobj = it->second;
-        std::vector<CGovernanceVote> vecVotes = govobj.GetVoteFile().GetVotes();
-        for(size_t i = 0; i < vecVotes.size(); ++i) {
-            mapVoteToObject.Insert(vecVotes[i].GetHash(), &govobj);
+        const CGovernanceObjectVoteFile& fileVotes = govobj.GetVoteFile();
+        for(CGovernanceObjectVoteFile::vote_l_cit itVote = fileVotes.begin(); itVote != fileVotes.end(); ++itVote) {
+            mapVoteToObject.Insert(itVote->GetHash(), &govobj);
         }
     }
 }
@@ -31,6 +31,14 @@ typedef std::pair<CGovernanceObject, int64_t> object_time_pair_t;
 
 static const int RATE_BUFFER_SIZE = 5;
 
+/// Limits for batched vote sync: objects per request and votes per reply
+static const size_t MAX_GOVERNANCE_VOTE_SYNC_OBJECTS = 100;
+static const size_t MAX_GOVERNANCE_VOTE_SYNC_VOTES = 1000;
+/// How long we wait for the votes of a batched vote sync request
+static const int64_t GOVERNANCE_VOTE_SYNC_TIMEOUT = 10*60;
+/// Votes may reach a peer this long after their timestamp, so watermarks are kept this far behind
+static const int64_t GOVERNANCE_VOTE_SYNC_WATERMARK_SLACK = 60*60;
+
 class CRateCheckBuffer {
 private:
     std::vector<int64_t> vecTimestamps;
@@ -222,6 +230,10 @@ public: // Types
 
     typedef hash_time_m_t::const_iterator hash_time_m_cit;
 
+    typedef std::map<NodeId, hash_time_m_t> vote_sync_m_t;
+
+    typedef vote_sync_m_t::iterator vote_sync_m_it;
+
 private:
     static const int MAX_CACHE_SIZE = 1000000;
 
@@ -258,6 +270,12 @@ private:
 
     hash_s_t setRequestedVotes;
 
+    // objects whose votes we asked a peer for with a batched vote sync, and when
+    vote_sync_m_t mapVoteSyncRequests;
+
+    // time up to which we received all votes for an object from a batched vote sync
+    hash_time_m_t mapVoteSyncWatermarks;
+
     bool fRateChecksEnabled;
 
 public:
@@ -284,6 +302,9 @@ public:
 
     void Sync(CNode* node, const uint256& nProp, const CBloomFilter& filter);
 
+    /// Send the votes for a set of objects, not older than nMinTime, in bulk messages
+    void SyncVotes(CNode* pfrom, const std::vector<uint256>& vecHashes, int64_t nMinTime, const CBloomFilter& filter);
+
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     void DoMaintenance();
@@ -317,6 +338,8 @@ public:
         mapInvalidVotes.Clear();
         mapOrphanVotes.Clear();
         mapLastMasternodeObject.clear();
+        mapVoteSyncRequests.clear();
+        mapVoteSyncWatermarks.clear();
     }
 
     std::string ToString() const;
@@ -348,6 +371,29 @@ public:
         }
     }
 
+    /// Same content as SerializationOp, laid out as CFlatJournalDB records
+    template <typename Journal>
+    void JournalOp(Journal& journal) {
+        LOCK(cs);
+        std::string strVersion;
+        if(!journal.ForRead()) {
+            strVersion = SERIALIZATION_VERSION_STRING;
+        }
+        journal.Value(0, strVersion);
+        journal.Map(1, mapSeenGovernanceObjects);
+        journal.Value(2, mapInvalidVotes);
+        journal.Value(3, mapOrphanVotes);
+        journal.Map(4, mapObjects);
+        journal.Map(5, mapWatchdogObjects);
+        journal.Value(6, nHashWatchdogCurrent);
+        journal.Value(7, nTimeWatchdogCurrent);
+        journal.Map(8, mapLastMasternodeObject);
+        journal.Commit();
+        if(journal.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
+            Clear();
+        }
+    }
+
     void UpdatedBlockTip(const CBlockIndex *pindex);
     int64_t GetLastDiffTime() { return nTimeLastDiff; }
     void UpdateLastDiffTime(int64_t nTimeIn) { nTimeLastDiff = nTimeIn; }
@@ -398,6 +444,9 @@ public:
 private:
     void RequestGovernanceObject(CNode* pfrom, const uint256& nHash, bool fUseFilter = false);
 
+    /// Ask a peer for the votes of several objects at once (see SyncVotes)
+    void RequestGovernanceVoteSync(CNode* pfrom, const std::vector<uint256>& vecHashes);
+
     void AddInvalidVote(const CGovernanceVote& vote)
     {
         mapInvalidVotes.Insert(vote.GetHash(), vote);
@@ -18,6 +18,7 @@
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/neoscrypt.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -171,22 +172,49 @@ public:
         try {
             return CCoinsViewBacked::GetCoins(txid, coins);
         } catch(const std::runtime_error& e) {
-            uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
-            LogPrintf("Error reading from database: %s\n", e.what());
-            // Starting the shutdown sequence and returning false to the caller would be
-            // interpreted as 'entry not found' (as opposed to unable to read data), and
-            // could lead to invalid interpretation. Just exit immediately, as we can't
-            // continue anyway, and all writes should be atomic.
-            abort();
+            ReadError(e);
+        }
+        return false;
+    }
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const {
+        try {
+            CCoinsViewBacked::GetCoinsBatch(vTxid, vCoinsRet);
+        } catch(const std::runtime_error& e) {
+            ReadError(e);
         }
     }
     // Writes do not need similar protection, as failure to write is handled by the caller.
+
+private:
+    static void ReadError(const std::runtime_error& e) {
+        uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+        LogPrintf("Error reading from database: %s\n", e.what());
+        // Starting the shutdown sequence and returning false to the caller would be
+        // interpreted as 'entry not found' (as opposed to unable to read data), and
+        // could lead to invalid interpretation. Just exit immediately, as we can't
+        // continue anyway, and all writes should be atomic.
+        abort();
+    }
 };
 
 static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
+// Journals of the masternode, payment and governance caches, kept across load
+// and dump so that each flush only has to append what changed
+static CFlatJournalDB<CMasternodeMan> journalMasternodes("mncache.log", "mncache.dat", "magicMasternodeCache");
+static CFlatJournalDB<CMasternodePayments> journalPayments("mnpayments.log", "mnpayments.dat", "magicMasternodePaymentsCache");
+static CFlatJournalDB<CGovernanceManager> journalGovernance("governance.log", "governance.dat", "magicGovernanceCache");
+static const int64_t MASTERNODE_CACHE_FLUSH_INTERVAL = 5 * 60;
+
+static void FlushMasternodeCaches()
+{
+    journalMasternodes.Flush(mnodeman);
+    journalPayments.Flush(mnpayments);
+    journalGovernance.Flush(governance);
+}
+
 void Interrupt(boost::thread_group& threadGroup)
 {
     InterruptHTTPServer();
@@ -226,12 +254,9 @@ void PrepareShutdown()
     StopNode();
 
     // STORE DATA CACHES INTO SERIALIZED DAT FILES
-    CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
-    flatdb1.Dump(mnodeman);
-    CFlatDB<CMasternodePayments> flatdb2("mnpayments.dat", "magicMasternodePaymentsCache");
-    flatdb2.Dump(mnpayments);
-    CFlatDB<CGovernanceManager> flatdb3("governance.dat", "magicGovernanceCache");
-    flatdb3.Dump(governance);
+    journalMasternodes.Dump(mnodeman);
+    journalPayments.Dump(mnpayments);
+    journalGovernance.Dump(governance);
     CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
     flatdb4.Dump(netfulfilledman);
 
@@ -252,6 +277,8 @@ void PrepareShutdown()
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
+            if (GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT) && !fReindex)
+                WriteBlockIndexSnapshot();
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
@@ -380,6 +407,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockindexsnapshot", strprintf(_("Save the block index to a snapshot file on shutdown and load it on the next start instead of the block index database (default: %u)"), DEFAULT_BLOCK_INDEX_SNAPSHOT));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -430,6 +458,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 if no -proxy or -connect)"));
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (temporary service connections excluded) (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
+    strUsage += HelpMessageOpt("-messageworkers=<n>", strprintf(_("Set the number of threads processing masternode, governance and InstantSend messages (0 = on the message handler thread, max: %d, default: %d)"), MAX_MESSAGE_WORKERS, DEFAULT_MESSAGE_WORKERS));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), GetSupportedSocketEvents(), DEFAULT_SOCKETEVENTS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
@@ -990,8 +1020,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEvents == "select")
+        fSocketEventsEpoll = false;
+#ifdef USE_EPOLL
+    else if (strSocketEvents == "epoll")
+        fSocketEventsEpoll = true;
+#endif
+    else
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"), strSocketEvents, GetSupportedSocketEvents()));
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // (only select() is bound to FD_SETSIZE)
+    if (!fSocketEventsEpoll)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1047,6 +1089,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nMessageWorkers = std::max(0, std::min((int)GetArg("-messageworkers", DEFAULT_MESSAGE_WORKERS), MAX_MESSAGE_WORKERS));
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -1174,6 +1218,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
 
+    // Pick the fastest NeoScrypt kernels this processor runs correctly
+    const char* pszNeoScryptKernels = neoscrypt_autodetect();
+
     // Sanity check
     if (!InitSanityCheck())
         return InitError(_("Initialization sanity check failed. NeoBytes Core is shutting down."));
@@ -1215,6 +1262,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Default data directory %s\n", GetDefaultDataDir().string());
     LogPrintf("Using data directory %s\n", strDataDir);
     LogPrintf("Using config file %s\n", GetConfigFile().string());
+    LogPrintf("Using the '%s' NeoScrypt implementation\n", pszNeoScryptKernels);
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
@@ -1222,6 +1270,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // Header proof-of-work hashing uses as many threads; the two pools
+        // are never busy at the same time as both serve the message handler.
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderHashCheck);
+        // Masternode message signers are recovered ahead of processing
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadRecoverMessageSigners);
+        // Coins of the inputs of a block are read from disk in parallel
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsDBRead);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1874,22 +1932,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // LOAD SERIALIZED DAT FILES INTO DATA CACHES FOR INTERNAL USE
 
     uiInterface.InitMessage(_("Loading masternode cache..."));
-    CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
-    if(!flatdb1.Load(mnodeman)) {
-        return InitError("Failed to load masternode cache from mncache.dat");
+    if(!journalMasternodes.Load(mnodeman)) {
+        return InitError("Failed to load masternode cache from mncache.log");
     }
 
     if(mnodeman.size()) {
         uiInterface.InitMessage(_("Loading masternode payment cache..."));
-        CFlatDB<CMasternodePayments> flatdb2("mnpayments.dat", "magicMasternodePaymentsCache");
-        if(!flatdb2.Load(mnpayments)) {
-            return InitError("Failed to load masternode payments cache from mnpayments.dat");
+        if(!journalPayments.Load(mnpayments)) {
+            return InitError("Failed to load masternode payments cache from mnpayments.log");
         }
 
         uiInterface.InitMessage(_("Loading governance cache..."));
-        CFlatDB<CGovernanceManager> flatdb3("governance.dat", "magicGovernanceCache");
-        if(!flatdb3.Load(governance)) {
-            return InitError("Failed to load governance cache from governance.dat");
+        if(!journalGovernance.Load(governance)) {
+            return InitError("Failed to load governance cache from governance.log");
         }
         governance.InitOnLoad();
     } else {
@@ -1902,6 +1957,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         return InitError("Failed to load fulfilled requests cache from netfulfilled.dat");
     }
 
+    // Append changes to the cache journals as they accumulate rather than all at shutdown
+    scheduler.scheduleEvery(&FlushMasternodeCaches, MASTERNODE_CACHE_FLUSH_INTERVAL);
+
     // ********************************************************* Step 11c: update block tip in NeoBytes modules
 
     // force UpdatedBlockTip to initialize pCurrentBlockIndex for DS, MN payments and budgets
@@ -58,12 +58,14 @@ void CInstantSend::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
         CTxLockVote vote;
         vRecv >> vote;
 
-        LOCK2(cs_main, cs_instantsend);
-
         uint256 nVoteHash = vote.GetHash();
 
-        if(mapTxLockVotes.count(nVoteHash)) return;
-        mapTxLockVotes.insert(std::make_pair(nVoteHash, vote));
+        {
+            // drop votes we have seen already without waiting for cs_main
+            LOCK(cs_instantsend);
+            if(mapTxLockVotes.count(nVoteHash)) return;
+            mapTxLockVotes.insert(std::make_pair(nVoteHash, vote));
+        }
 
         ProcessTxLockVote(pfrom, vote);
 
@@ -114,7 +116,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest)
     std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     CTxLockCandidate& txLockCandidate = itLockCandidate->second;
     Vote(txLockCandidate);
-    ProcessOrphanTxLockVotes();
+    ProcessOrphanTxLockVotes(txHash);
 
     // Masternodes will sometimes propagate votes before the transaction is known to the client.
     // If this just happened - lock inputs, resolve conflicting locks, update transaction status
@@ -252,10 +254,19 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate)
 //received a consensus vote
 bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
 {
-    LOCK2(cs_main, cs_instantsend);
-
     uint256 txHash = vote.GetTxHash();
 
+    // Votes are verified in arrival order and the lock is finalized as soon as every outpoint
+    // has SIGNATURES_REQUIRED of them, whatever arrives after that is not worth verifying
+    // (or waiting for cs_main)
+    if(IsTxLockVoteRedundant(vote)) {
+        LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Outpoint already has enough votes, skipping: txid=%s  outpoint=%s  masternode=%s\n",
+                txHash.ToString(), vote.GetOutpoint().ToStringShort(), vote.GetMasternodeOutpoint().ToStringShort());
+        return false;
+    }
+
+    LOCK2(cs_main, cs_instantsend);
+
     if(!vote.IsValid(pfrom)) {
         // could be because of missing MN
         LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Vote is invalid, txid=%s\n", txHash.ToString());
@@ -268,7 +279,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
     std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end()) {
         if(!mapTxLockVotesOrphan.count(vote.GetHash())) {
-            mapTxLockVotesOrphan[vote.GetHash()] = vote;
+            AddOrphanTxLockVote(vote);
             LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Orphan vote: txid=%s  masternode=%s new\n",
                     txHash.ToString(), vote.GetMasternodeOutpoint().ToStringShort());
             bool fReprocess = true;
@@ -354,26 +365,72 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
     LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Transaction Lock signatures count: %d/%d, vote hash=%s\n",
             nSignatures, nSignaturesMax, vote.GetHash().ToString());
 
-    TryToFinalizeLockCandidate(txLockCandidate);
+    // only a vote completing its outpoint can complete the whole lock
+    if(txLockCandidate.mapOutPointLocks.find(vote.GetOutpoint())->second.IsReady()) {
+        TryToFinalizeLockCandidate(txLockCandidate);
+    }
 
     vote.Relay();
 
     return true;
 }
 
-void CInstantSend::ProcessOrphanTxLockVotes()
+void CInstantSend::ProcessOrphanTxLockVotes(const uint256& txHash)
 {
     LOCK2(cs_main, cs_instantsend);
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
-        if(ProcessTxLockVote(NULL, it->second)) {
-            mapTxLockVotesOrphan.erase(it++);
-        } else {
-            ++it;
+
+    std::map<uint256, std::map<COutPoint, std::set<uint256> > >::iterator itTx = mapTxLockVotesOrphanIndex.find(txHash);
+    if(itTx == mapTxLockVotesOrphanIndex.end()) return;
+
+    // only votes for this tx can be attached now, copy their hashes since processing can change the index
+    std::vector<uint256> vecVoteHashes;
+    std::map<COutPoint, std::set<uint256> >::iterator itOutpoint = itTx->second.begin();
+    while(itOutpoint != itTx->second.end()) {
+        vecVoteHashes.insert(vecVoteHashes.end(), itOutpoint->second.begin(), itOutpoint->second.end());
+        ++itOutpoint;
+    }
+
+    BOOST_FOREACH(const uint256& nVoteHash, vecVoteHashes) {
+        std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.find(nVoteHash);
+        if(it == mapTxLockVotesOrphan.end()) continue;
+        CTxLockVote vote = it->second;
+        if(ProcessTxLockVote(NULL, vote)) {
+            EraseOrphanTxLockVote(nVoteHash);
         }
     }
 }
 
+void CInstantSend::AddOrphanTxLockVote(const CTxLockVote& vote)
+{
+    uint256 nVoteHash = vote.GetHash();
+    mapTxLockVotesOrphan[nVoteHash] = vote;
+    mapTxLockVotesOrphanIndex[vote.GetTxHash()][vote.GetOutpoint()].insert(nVoteHash);
+    mapTxLockVotesOrphanExpiry[vote.GetTimeCreated()].push_back(nVoteHash);
+}
+
+void CInstantSend::EraseOrphanTxLockVote(const uint256& nVoteHash)
+{
+    // NOTE: expiry buckets are not touched, stale hashes there are skipped when the bucket expires
+    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.find(nVoteHash);
+    if(it == mapTxLockVotesOrphan.end()) return;
+
+    std::map<uint256, std::map<COutPoint, std::set<uint256> > >::iterator itTx = mapTxLockVotesOrphanIndex.find(it->second.GetTxHash());
+    if(itTx != mapTxLockVotesOrphanIndex.end()) {
+        std::map<COutPoint, std::set<uint256> >::iterator itOutpoint = itTx->second.find(it->second.GetOutpoint());
+        if(itOutpoint != itTx->second.end()) {
+            itOutpoint->second.erase(nVoteHash);
+            if(itOutpoint->second.empty()) {
+                itTx->second.erase(itOutpoint);
+            }
+        }
+        if(itTx->second.empty()) {
+            mapTxLockVotesOrphanIndex.erase(itTx);
+        }
+    }
+
+    mapTxLockVotesOrphan.erase(it);
+}
+
 bool CInstantSend::IsEnoughOrphanVotesForTx(const CTxLockRequest& txLockRequest)
 {
     // There could be a situation when we already have quite a lot of votes
@@ -389,20 +446,13 @@ bool CInstantSend::IsEnoughOrphanVotesForTx(const CTxLockRequest& txLockRequest)
 
 bool CInstantSend::IsEnoughOrphanVotesForTxAndOutPoint(const uint256& txHash, const COutPoint& outpoint)
 {
-    // Scan orphan votes to check if this outpoint has enough orphan votes to be locked in some tx.
+    // Check if this outpoint has enough orphan votes to be locked in this tx.
     LOCK2(cs_main, cs_instantsend);
-    int nCountVotes = 0;
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
-        if(it->second.GetTxHash() == txHash && it->second.GetOutpoint() == outpoint) {
-            nCountVotes++;
-            if(nCountVotes >= COutPointLock::SIGNATURES_REQUIRED) {
-                return true;
-            }
-        }
-        ++it;
-    }
-    return false;
+    std::map<uint256, std::map<COutPoint, std::set<uint256> > >::iterator itTx = mapTxLockVotesOrphanIndex.find(txHash);
+    if(itTx == mapTxLockVotesOrphanIndex.end()) return false;
+    std::map<COutPoint, std::set<uint256> >::iterator itOutpoint = itTx->second.find(outpoint);
+    if(itOutpoint == itTx->second.end()) return false;
+    return (int)itOutpoint->second.size() >= COutPointLock::SIGNATURES_REQUIRED;
 }
 
 void CInstantSend::TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCandidate)
@@ -463,6 +513,19 @@ void CInstantSend::LockTransactionInputs(const CTxLockCandidate& txLockCandidate
     LogPrint("instantsend", "CInstantSend::LockTransactionInputs -- done, txid=%s\n", txHash.ToString());
 }
 
+bool CInstantSend::IsTxLockVoteRedundant(const CTxLockVote& vote)
+{
+    LOCK(cs_instantsend);
+
+    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(vote.GetTxHash());
+    if(itLockCandidate == mapTxLockCandidates.end()) return false;
+
+    std::map<COutPoint, COutPointLock>::iterator itOutpointLock = itLockCandidate->second.mapOutPointLocks.find(vote.GetOutpoint());
+    if(itOutpointLock == itLockCandidate->second.mapOutPointLocks.end()) return false;
+
+    return itOutpointLock->second.IsReady();
+}
+
 bool CInstantSend::GetLockedOutPointTxHash(const COutPoint& outpoint, uint256& hashRet)
 {
     LOCK(cs_instantsend);
@@ -618,17 +681,19 @@ void CInstantSend::CheckAndRemove()
         }
     }
 
-    // remove expired orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(GetTime() - itOrphanVote->second.GetTimeCreated() > ORPHAN_VOTE_SECONDS) {
+    // remove expired orphan votes, oldest buckets first
+    std::map<int64_t, std::vector<uint256> >::iterator itOrphanExpiry = mapTxLockVotesOrphanExpiry.begin();
+    while(itOrphanExpiry != mapTxLockVotesOrphanExpiry.end() && GetTime() - itOrphanExpiry->first > ORPHAN_VOTE_SECONDS) {
+        BOOST_FOREACH(const uint256& nVoteHash, itOrphanExpiry->second) {
+            std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.find(nVoteHash);
+            // skip votes which were attached to their lock candidate in the meantime
+            if(itOrphanVote == mapTxLockVotesOrphan.end() || itOrphanVote->second.GetTimeCreated() != itOrphanExpiry->first) continue;
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired orphan vote: txid=%s  masternode=%s\n",
                     itOrphanVote->second.GetTxHash().ToString(), itOrphanVote->second.GetMasternodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itOrphanVote->first);
-            mapTxLockVotesOrphan.erase(itOrphanVote++);
-        } else {
-            ++itOrphanVote;
+            mapTxLockVotes.erase(nVoteHash);
+            EraseOrphanTxLockVote(nVoteHash);
         }
+        mapTxLockVotesOrphanExpiry.erase(itOrphanExpiry++);
     }
 
     // remove expired masternode orphan votes (DOS protection)
@@ -820,14 +885,16 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 
     // check orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(itOrphanVote->second.GetTxHash() == txHash) {
+    std::map<uint256, std::map<COutPoint, std::set<uint256> > >::iterator itOrphanTx = mapTxLockVotesOrphanIndex.find(txHash);
+    if(itOrphanTx == mapTxLockVotesOrphanIndex.end()) return;
+    std::map<COutPoint, std::set<uint256> >::iterator itOrphanOutpoint = itOrphanTx->second.begin();
+    while(itOrphanOutpoint != itOrphanTx->second.end()) {
+        BOOST_FOREACH(const uint256& nVoteHash, itOrphanOutpoint->second) {
             LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
-                    txHash.ToString(), nHeightNew, itOrphanVote->first.ToString());
-            mapTxLockVotes[itOrphanVote->first].SetConfirmedHeight(nHeightNew);
+                    txHash.ToString(), nHeightNew, nVoteHash.ToString());
+            mapTxLockVotes[nVoteHash].SetConfirmedHeight(nHeightNew);
         }
-        ++itOrphanVote;
+        ++itOrphanOutpoint;
     }
 }
 
@@ -1010,10 +1077,15 @@ uint256 CTxLockVote::GetHash() const
     return ss.GetHash();
 }
 
+std::string CTxLockVote::GetSignatureMessage() const
+{
+    return txHash.ToString() + outpoint.ToStringShort();
+}
+
 bool CTxLockVote::CheckSignature() const
 {
     std::string strError;
-    std::string strMessage = txHash.ToString() + outpoint.ToStringShort();
+    std::string strMessage = GetSignatureMessage();
 
     masternode_info_t infoMn = mnodeman.GetMasternodeInfo(CTxIn(outpointMasternode));
 
@@ -1033,7 +1105,7 @@ bool CTxLockVote::CheckSignature() const
 bool CTxLockVote::Sign()
 {
     std::string strError;
-    std::string strMessage = txHash.ToString() + outpoint.ToStringShort();
+    std::string strMessage = GetSignatureMessage();
 
     if(!darkSendSigner.SignMessage(strMessage, vchMasternodeSignature, activeMasternode.keyMasternode)) {
         LogPrintf("CTxLockVote::Sign -- SignMessage() failed\n");
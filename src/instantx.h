@@ -48,6 +48,8 @@ private:
     std::map<uint256, CTxLockRequest> mapLockRequestRejected; // tx hash - tx
     std::map<uint256, CTxLockVote> mapTxLockVotes; // vote hash - vote
     std::map<uint256, CTxLockVote> mapTxLockVotesOrphan; // vote hash - vote
+    std::map<uint256, std::map<COutPoint, std::set<uint256> > > mapTxLockVotesOrphanIndex; // tx hash - utxo - vote hash set
+    std::map<int64_t, std::vector<uint256> > mapTxLockVotesOrphanExpiry; // time created - vote hashes
 
     std::map<uint256, CTxLockCandidate> mapTxLockCandidates; // tx hash - lock candidate
 
@@ -62,7 +64,9 @@ private:
 
     //process consensus vote message
     bool ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote);
-    void ProcessOrphanTxLockVotes();
+    void ProcessOrphanTxLockVotes(const uint256& txHash);
+    void AddOrphanTxLockVote(const CTxLockVote& vote);
+    void EraseOrphanTxLockVote(const uint256& nVoteHash);
     bool IsEnoughOrphanVotesForTx(const CTxLockRequest& txLockRequest);
     bool IsEnoughOrphanVotesForTxAndOutPoint(const uint256& txHash, const COutPoint& outpoint);
     int64_t GetAverageMasternodeOrphanVoteTime();
@@ -90,6 +94,8 @@ public:
     bool GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLockRequestRet);
 
     bool GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet);
+    // vote is for an outpoint which already has enough signatures, no need to verify it
+    bool IsTxLockVoteRedundant(const CTxLockVote& vote);
 
     bool GetLockedOutPointTxHash(const COutPoint& outpoint, uint256& hashRet);
 
@@ -181,11 +187,14 @@ public:
     COutPoint GetOutpoint() const { return outpoint; }
     COutPoint GetMasternodeOutpoint() const { return outpointMasternode; }
     int64_t GetTimeCreated() const { return nTimeCreated; }
+    const std::vector<unsigned char>& GetSignature() const { return vchMasternodeSignature; }
 
     bool IsValid(CNode* pnode) const;
     void SetConfirmedHeight(int nConfirmedHeightIn) { nConfirmedHeight = nConfirmedHeightIn; }
     bool IsExpired(int nHeight) const;
 
+    /// The message covered by vchMasternodeSignature
+    std::string GetSignatureMessage() const;
     bool Sign();
     bool CheckSignature() const;
 
@@ -580,6 +580,7 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals)
     nodeSignals.GetHeight.connect(&GetHeight);
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
     nodeSignals.SendMessages.connect(&SendMessages);
+    nodeSignals.ProcessWorkerMessage.connect(&ProcessWorkerMessage);
     nodeSignals.InitializeNode.connect(&InitializeNode);
     nodeSignals.FinalizeNode.connect(&FinalizeNode);
 }
@@ -589,6 +590,7 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
     nodeSignals.GetHeight.disconnect(&GetHeight);
     nodeSignals.ProcessMessages.disconnect(&ProcessMessages);
     nodeSignals.SendMessages.disconnect(&SendMessages);
+    nodeSignals.ProcessWorkerMessage.disconnect(&ProcessWorkerMessage);
     nodeSignals.InitializeNode.disconnect(&InitializeNode);
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
 }
@@ -1680,7 +1682,7 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+static bool ReadBlockDataFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
@@ -1697,6 +1699,14 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    if (!ReadBlockDataFromDisk(block, pos))
+        return false;
+
     // Check the header
     if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
@@ -1706,11 +1716,32 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
+    if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+        if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
+            return false;
+        if (block.GetHash() != pindex->GetBlockHash())
+            return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                    pindex->ToString(), pindex->GetBlockPos().ToString());
+        return true;
+    }
+
+    // The block was fully validated when it was connected, so its proof of work
+    // has already been checked against this index entry. Instead of running
+    // neoscrypt again, tie the data on disk to the entry by comparing the header
+    // fields and the merkle root (the txids are computed while deserializing).
+    if (!ReadBlockDataFromDisk(block, pindex->GetBlockPos()))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash())
-        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+    bool fMutated = false;
+    if (block.nVersion != pindex->nVersion ||
+        block.hashPrevBlock != (pindex->pprev ? pindex->pprev->GetBlockHash() : uint256()) ||
+        block.hashMerkleRoot != pindex->hashMerkleRoot ||
+        block.nTime != pindex->nTime ||
+        block.nBits != pindex->nBits ||
+        block.nNonce != pindex->nNonce ||
+        BlockMerkleRoot(block, &fMutated) != block.hashMerkleRoot || fMutated)
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): block data doesn't match index for %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
+    block.SetCachedHash(pindex->GetBlockHash());
     return true;
 }
 
@@ -1913,12 +1944,24 @@ void CheckForkWarningConditionsOnNewFork(CBlockIndex* pindexNewForkTip)
     CheckForkWarningConditions();
 }
 
-// Requires cs_main.
+/** Misbehavior reported while cs_main was held by another thread, see ApplyPendingMisbehavior */
+static std::map<NodeId, int> mapMisbehaviorPending;
+static CCriticalSection cs_mapMisbehaviorPending;
+
+// Doesn't wait for cs_main: message workers call this too. If another thread
+// holds cs_main the score is added by the next SendMessages instead.
 void Misbehaving(NodeId pnode, int howmuch)
 {
     if (howmuch == 0)
         return;
 
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain) {
+        LOCK(cs_mapMisbehaviorPending);
+        mapMisbehaviorPending[pnode] += howmuch;
+        return;
+    }
+
     CNodeState *state = State(pnode);
     if (state == NULL)
         return;
@@ -1933,6 +1976,18 @@ void Misbehaving(NodeId pnode, int howmuch)
         LogPrintf("%s: %s (%d -> %d)\n", __func__, state->name, state->nMisbehavior-howmuch, state->nMisbehavior);
 }
 
+// Requires cs_main.
+static void ApplyPendingMisbehavior()
+{
+    std::map<NodeId, int> mapPending;
+    {
+        LOCK(cs_mapMisbehaviorPending);
+        mapPending.swap(mapMisbehaviorPending);
+    }
+    for (std::map<NodeId, int>::const_iterator it = mapPending.begin(); it != mapPending.end(); ++it)
+        Misbehaving(it->first, it->second);
+}
+
 void static InvalidChainFound(CBlockIndex* pindexNew)
 {
     if (!pindexBestInvalid || pindexNew->nChainWork > pindexBestInvalid->nChainWork)
@@ -2416,6 +2471,59 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Closure computing the neoscrypt hash of one header on a worker thread. The
+ * hash is left in the header's cache, so the AcceptBlockHeader call that
+ * follows does not compute it again. Failing the proof of work stops the
+ * rest of the batch early.
+ */
+class CHeaderHashCheck
+{
+private:
+    const CBlockHeader* pheader;
+    const Consensus::Params* pconsensusParams;
+
+public:
+    CHeaderHashCheck(): pheader(NULL), pconsensusParams(NULL) {}
+    CHeaderHashCheck(const CBlockHeader& headerIn, const Consensus::Params& consensusParamsIn) :
+        pheader(&headerIn), pconsensusParams(&consensusParamsIn) {}
+
+    bool operator()() {
+        return CheckProofOfWork(pheader->GetHash(), pheader->nBits, *pconsensusParams);
+    }
+
+    void swap(CHeaderHashCheck& check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pconsensusParams, check.pconsensusParams);
+    }
+};
+
+static CCheckQueue<CHeaderHashCheck> headerhashqueue(8);
+
+void ThreadHeaderHashCheck() {
+    RenameThread("neobytes-hdrhash");
+    headerhashqueue.Thread();
+}
+
+/**
+ * Hash a batch of headers across the header hash threads, ahead of their
+ * sequential validation. A header failing its proof of work is left for
+ * AcceptBlockHeader to find and report.
+ */
+static void PrecomputeHeaderHashes(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams)
+{
+    if (!nScriptCheckThreads || headers.size() < 2)
+        return;
+
+    CCheckQueueControl<CHeaderHashCheck> control(&headerhashqueue);
+    std::vector<CHeaderHashCheck> vChecks;
+    vChecks.reserve(headers.size());
+    BOOST_FOREACH(const CBlockHeader& header, headers)
+        vChecks.push_back(CHeaderHashCheck(header, consensusParams));
+    control.Add(vChecks);
+    control.Wait();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2535,12 +2643,36 @@ static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/**
+ * Load the coins spent by block into view ahead of connecting it. Coins of
+ * transactions created by the block itself are left out, the others which are
+ * not cached yet are retrieved from disk in one batch. Returns their number.
+ */
+static size_t PrefetchBlockInputs(const CBlock& block, const CCoinsViewCache& view)
+{
+    std::set<uint256> setBlockTxids;
+    std::vector<uint256> vTxid;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if (!tx.IsCoinBase()) {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (!setBlockTxids.count(txin.prevout.hash))
+                    vTxid.push_back(txin.prevout.hash);
+            }
+        }
+        setBlockTxids.insert(tx.GetHash());
+    }
+    std::sort(vTxid.begin(), vTxid.end());
+    vTxid.erase(std::unique(vTxid.begin(), vTxid.end()), vTxid.end());
+    return view.PrefetchCoins(vTxid);
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck)
 {
     const CChainParams& chainparams = Params();
@@ -2639,6 +2771,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
+    // Warm the cache for the serial pass over the transactions below
+    size_t nPrefetched = PrefetchBlockInputs(block, view);
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+    LogPrint("bench", "      - Prefetch %u coins: %.2fms [%.2fs]\n", (unsigned)nPrefetched, 0.001 * (nTimePrefetched - nTime2), nTimePrefetch * 0.000001);
+
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
@@ -4245,27 +4382,236 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
-bool static LoadBlockIndexDB()
+/** Check the proof of work and compute the work of a range of block index entries. */
+static void CheckBlockIndexRange(const std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight, size_t nBegin, size_t nEnd,
+                                 std::vector<arith_uint256>& vBlockProof, const Consensus::Params& consensusParams,
+                                 CBlockIndex*& pindexFailed)
 {
-    const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts())
-        return false;
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        if (!CheckProofOfWork(pindex->GetBlockHash(), pindex->nBits, consensusParams)) {
+            pindexFailed = pindex;
+            return;
+        }
+        vBlockProof[i] = GetBlockProof(*pindex);
+    }
+}
+
+/**
+ * Check the proof of work and compute the work of all block index entries,
+ * split across the script verification threads (-par) as none of it depends
+ * on other entries. The caller adds the work up in height order.
+ */
+static bool CheckBlockIndexProofs(const std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight,
+                                  std::vector<arith_uint256>& vBlockProof, const Consensus::Params& consensusParams)
+{
+    size_t nThreads = std::max(nScriptCheckThreads, 1);
+    size_t nPerThread = (vSortedByHeight.size() + nThreads - 1) / nThreads;
+    std::vector<CBlockIndex*> vFailed(nThreads, (CBlockIndex*)NULL);
+    vBlockProof.resize(vSortedByHeight.size());
+
+    boost::thread_group threads;
+    for (size_t n = 1; n < nThreads; n++) {
+        size_t nBegin = std::min(n * nPerThread, vSortedByHeight.size());
+        size_t nEnd = std::min(nBegin + nPerThread, vSortedByHeight.size());
+        threads.create_thread(boost::bind(&CheckBlockIndexRange, boost::cref(vSortedByHeight), nBegin, nEnd,
+                                          boost::ref(vBlockProof), boost::cref(consensusParams), boost::ref(vFailed[n])));
+    }
+    CheckBlockIndexRange(vSortedByHeight, 0, std::min(nPerThread, vSortedByHeight.size()), vBlockProof, consensusParams, vFailed[0]);
+    threads.join_all();
+
+    BOOST_FOREACH(const CBlockIndex* pindex, vFailed) {
+        if (pindex)
+            return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindex->ToString());
+    }
+    return true;
+}
+
+static const int BLOCK_INDEX_SNAPSHOT_VERSION = 1;
 
-    boost::this_thread::interruption_point();
+/** Whether mapBlockIndex holds everything from the block tree DB, and so may be written to a snapshot. */
+static bool fBlockIndexLoaded = false;
+
+static boost::filesystem::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+/**
+ * The snapshot holds the network magic, a version, the best block of the coins
+ * database at the time of writing and the number of entries, followed by every
+ * entry of mapBlockIndex in height order as a CDiskBlockIndex with its
+ * nChainWork. A hash of all that closes the file.
+ */
+bool WriteBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
+
+    if (!fBlockIndexLoaded)
+        return false;
 
-    // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
-    }
+        vSortedByHeight.push_back(make_pair(item.second->nHeight, item.second));
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
+
+    CDataStream ssSnapshot(SER_DISK, CLIENT_VERSION);
+    ssSnapshot << FLATDATA(Params().MessageStart());
+    ssSnapshot << BLOCK_INDEX_SNAPSHOT_VERSION;
+    ssSnapshot << pcoinsTip->GetBestBlock();
+    ssSnapshot << (uint64_t)vSortedByHeight.size();
+    for (size_t i = 0; i < vSortedByHeight.size(); i++) {
+        const CBlockIndex* pindex = vSortedByHeight[i].second;
+        ssSnapshot << CDiskBlockIndex(pindex);
+        ssSnapshot << ArithToUint256(pindex->nChainWork);
+    }
+    uint256 hash = Hash(ssSnapshot.begin(), ssSnapshot.end());
+    ssSnapshot << hash;
+
+    boost::filesystem::path pathSnapshot = GetBlockIndexSnapshotPath();
+    boost::filesystem::path pathTmp = pathSnapshot;
+    pathTmp += ".new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    try {
+        fileout << ssSnapshot;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, pathSnapshot))
+        return error("%s: Rename-into-place failed", __func__);
+
+    LogPrintf("%s: wrote %u entries\n", __func__, vSortedByHeight.size());
+    return true;
+}
+
+/**
+ * Load mapBlockIndex from the snapshot written at the last clean shutdown. The
+ * snapshot is only adopted if it belongs to this network and to the current
+ * state of the coins database. On success the entries are returned in height
+ * order, with nChainWork already set.
+ */
+static bool ReadBlockIndexSnapshot(vector<pair<int, CBlockIndex*> >& vSortedByHeight)
+{
+    boost::filesystem::path pathSnapshot = GetBlockIndexSnapshotPath();
+    FILE *file = fopen(pathSnapshot.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+
+    vector<unsigned char> vchData;
+    uint256 hashIn;
+    try {
+        uint64_t fileSize = boost::filesystem::file_size(pathSnapshot);
+        if (fileSize < sizeof(uint256))
+            return error("%s: Snapshot file too short", __func__);
+        vchData.resize(fileSize - sizeof(uint256));
+        if (!vchData.empty())
+            filein.read((char *)&vchData[0], vchData.size());
+        filein >> hashIn;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    filein.fclose();
+
+    CDataStream ssSnapshot(vchData, SER_DISK, CLIENT_VERSION);
+    if (hashIn != Hash(ssSnapshot.begin(), ssSnapshot.end()))
+        return error("%s: Checksum mismatch, data corrupted", __func__);
+
+    try {
+        unsigned char pchMsgTmp[4];
+        int nSnapshotVersion;
+        uint256 hashBestBlock;
+        uint64_t nEntries;
+        ssSnapshot >> FLATDATA(pchMsgTmp) >> nSnapshotVersion >> hashBestBlock >> nEntries;
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("%s: Invalid network magic number", __func__);
+        if (nSnapshotVersion != BLOCK_INDEX_SNAPSHOT_VERSION) {
+            LogPrintf("%s: ignoring snapshot version %d\n", __func__, nSnapshotVersion);
+            return false;
+        }
+        if (hashBestBlock != pcoinsTip->GetBestBlock()) {
+            LogPrintf("%s: snapshot is for best block %s, not %s\n", __func__, hashBestBlock.ToString(), pcoinsTip->GetBestBlock().ToString());
+            return false;
+        }
+
+        vSortedByHeight.reserve(nEntries);
+        for (uint64_t n = 0; n < nEntries; n++) {
+            CDiskBlockIndex diskindex;
+            uint256 nChainWork;
+            ssSnapshot >> diskindex >> nChainWork;
+
+            CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nChainWork     = UintToArith256(nChainWork);
+            vSortedByHeight.push_back(make_pair(pindexNew->nHeight, pindexNew));
+        }
+        if (vSortedByHeight.size() != mapBlockIndex.size())
+            throw std::runtime_error("entries refer to missing predecessors");
+    }
+    catch (const std::exception& e) {
+        // Start over from the block tree DB
+        BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex)
+            delete entry.second;
+        mapBlockIndex.clear();
+        vSortedByHeight.clear();
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
+
+    LogPrintf("%s: loaded %u entries\n", __func__, vSortedByHeight.size());
+    return true;
+}
+
+bool static LoadBlockIndexDB()
+{
+    const CChainParams& chainparams = Params();
+
+    // Prefer the snapshot from the last clean shutdown over reading and
+    // checking all entries of the block tree DB again
+    vector<pair<int, CBlockIndex*> > vSortedByHeight;
+    vector<arith_uint256> vBlockProof;
+    bool fSnapshot = GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT) && ReadBlockIndexSnapshot(vSortedByHeight);
+    if (!fSnapshot) {
+        if (!pblocktree->LoadBlockIndexGuts())
+            return false;
+
+        boost::this_thread::interruption_point();
+
+        // Calculate nChainWork
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+        if (!CheckBlockIndexProofs(vSortedByHeight, vBlockProof, chainparams.GetConsensus()))
+            return false;
+    }
+    for (size_t i = 0; i < vSortedByHeight.size(); i++)
     {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        if (!fSnapshot)
+            pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vBlockProof[i];
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -4458,6 +4804,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    fBlockIndexLoaded = false;
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
@@ -4494,6 +4841,15 @@ bool LoadBlockIndex()
     // Load block index from databases
     if (!fReindex && !LoadBlockIndexDB())
         return false;
+
+    // A snapshot only describes the block tree DB as it was left by the clean
+    // shutdown that wrote it, and is of no use once this run changes the DB
+    try {
+        boost::filesystem::remove(GetBlockIndexSnapshotPath());
+    } catch (const boost::filesystem::filesystem_error& e) {
+        return error("%s: Unable to remove block index snapshot: %s", __func__, e.what());
+    }
+    fBlockIndexLoaded = true;
     return true;
 }
 
@@ -4989,6 +5345,24 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/** Send the serialized message kept for inv to pfrom, returns false if there is none */
+static bool PushRelayMessageCache(CNode* pfrom, const CInv& inv)
+{
+    CSendBufferRef msg = GetRelayMessageCache(inv);
+    if (!msg)
+        return false;
+    pfrom->PushSerializedMessage(msg);
+    return true;
+}
+
+/** Send the serialized object for inv to pfrom and keep the message for other peers asking for it */
+static void PushRelayMessage(CNode* pfrom, const CInv& inv, const char* pszCommand, const CDataStream& ss)
+{
+    CSendBufferRef msg = CNode::SerializeMessage(pszCommand, ss);
+    AddRelayMessageCache(inv, msg);
+    pfrom->PushSerializedMessage(msg);
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -5124,13 +5498,17 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    CTxLockVote vote;
-                    if(instantsend.GetTxLockVote(inv.hash, vote)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << vote;
-                        pfrom->PushMessage(NetMsgType::TXLOCKVOTE, ss);
+                    if(PushRelayMessageCache(pfrom, inv)) {
                         pushed = true;
+                    } else {
+                        CTxLockVote vote;
+                        if(instantsend.GetTxLockVote(inv.hash, vote)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << vote;
+                            PushRelayMessage(pfrom, inv, NetMsgType::TXLOCKVOTE, ss);
+                            pushed = true;
+                        }
                     }
                 }
 
@@ -5146,10 +5524,12 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
                 if (!pushed && inv.type == MSG_MASTERNODE_PAYMENT_VOTE) {
                     if(mnpayments.HasVerifiedPaymentVote(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnpayments.mapMasternodePaymentVotes[inv.hash];
-                        pfrom->PushMessage(NetMsgType::MASTERNODEPAYMENTVOTE, ss);
+                        if(!PushRelayMessageCache(pfrom, inv)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnpayments.mapMasternodePaymentVotes[inv.hash];
+                            PushRelayMessage(pfrom, inv, NetMsgType::MASTERNODEPAYMENTVOTE, ss);
+                        }
                         pushed = true;
                     }
                 }
@@ -5162,10 +5542,13 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                             std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
                             BOOST_FOREACH(uint256& hash, vecVoteHashes) {
                                 if(mnpayments.HasVerifiedPaymentVote(hash)) {
-                                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                                    ss.reserve(1000);
-                                    ss << mnpayments.mapMasternodePaymentVotes[hash];
-                                    pfrom->PushMessage(NetMsgType::MASTERNODEPAYMENTVOTE, ss);
+                                    CInv invVote(MSG_MASTERNODE_PAYMENT_VOTE, hash);
+                                    if(!PushRelayMessageCache(pfrom, invVote)) {
+                                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                                        ss.reserve(1000);
+                                        ss << mnpayments.mapMasternodePaymentVotes[hash];
+                                        PushRelayMessage(pfrom, invVote, NetMsgType::MASTERNODEPAYMENTVOTE, ss);
+                                    }
                                 }
                             }
                         }
@@ -5175,20 +5558,24 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
                 if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
                     if(mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)){
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash].second;
-                        pfrom->PushMessage(NetMsgType::MNANNOUNCE, ss);
+                        if(!PushRelayMessageCache(pfrom, inv)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash].second;
+                            PushRelayMessage(pfrom, inv, NetMsgType::MNANNOUNCE, ss);
+                        }
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_MASTERNODE_PING) {
                     if(mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
-                        pfrom->PushMessage(NetMsgType::MNPING, ss);
+                        if(!PushRelayMessageCache(pfrom, inv)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnodeman.mapSeenMasternodePing[inv.hash];
+                            PushRelayMessage(pfrom, inv, NetMsgType::MNPING, ss);
+                        }
                         pushed = true;
                     }
                 }
@@ -5207,17 +5594,20 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     LogPrint("net", "ProcessGetData -- MSG_GOVERNANCE_OBJECT: inv = %s\n", inv.ToString());
                     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                     bool topush = false;
+                    bool fCached = false;
                     {
                         if(governance.HaveObjectForHash(inv.hash)) {
+                            fCached = PushRelayMessageCache(pfrom, inv);
                             ss.reserve(1000);
-                            if(governance.SerializeObjectForHash(inv.hash, ss)) {
+                            if(fCached || governance.SerializeObjectForHash(inv.hash, ss)) {
                                 topush = true;
                             }
                         }
                     }
                     LogPrint("net", "ProcessGetData -- MSG_GOVERNANCE_OBJECT: topush = %d, inv = %s\n", topush, inv.ToString());
                     if(topush) {
-                        pfrom->PushMessage(NetMsgType::MNGOVERNANCEOBJECT, ss);
+                        if(!fCached)
+                            PushRelayMessage(pfrom, inv, NetMsgType::MNGOVERNANCEOBJECT, ss);
                         pushed = true;
                     }
                 }
@@ -5225,27 +5615,32 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 if (!pushed && inv.type == MSG_GOVERNANCE_OBJECT_VOTE) {
                     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                     bool topush = false;
+                    bool fCached = false;
                     {
                         if(governance.HaveVoteForHash(inv.hash)) {
+                            fCached = PushRelayMessageCache(pfrom, inv);
                             ss.reserve(1000);
-                            if(governance.SerializeVoteForHash(inv.hash, ss)) {
+                            if(fCached || governance.SerializeVoteForHash(inv.hash, ss)) {
                                 topush = true;
                             }
                         }
                     }
                     if(topush) {
                         LogPrint("net", "ProcessGetData -- pushing: inv = %s\n", inv.ToString());
-                        pfrom->PushMessage(NetMsgType::MNGOVERNANCEOBJECTVOTE, ss);
+                        if(!fCached)
+                            PushRelayMessage(pfrom, inv, NetMsgType::MNGOVERNANCEOBJECTVOTE, ss);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_MASTERNODE_VERIFY) {
                     if(mnodeman.mapSeenMasternodeVerification.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeVerification[inv.hash];
-                        pfrom->PushMessage(NetMsgType::MNVERIFY, ss);
+                        if(!PushRelayMessageCache(pfrom, inv)) {
+                            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                            ss.reserve(1000);
+                            ss << mnodeman.mapSeenMasternodeVerification[inv.hash];
+                            PushRelayMessage(pfrom, inv, NetMsgType::MNVERIFY, ss);
+                        }
                         pushed = true;
                     }
                 }
@@ -5276,6 +5671,44 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+/**
+ * Masternode, governance and InstantSend messages which go to the message
+ * worker threads. Their handlers only take cs_main where they need the chain,
+ * and they lock their own state, so they get by without the message handler
+ * thread which may wait for block processing.
+ */
+static bool IsWorkerMessage(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::MNANNOUNCE ||
+           strCommand == NetMsgType::MNPING ||
+           strCommand == NetMsgType::DSEG ||
+           strCommand == NetMsgType::MNVERIFY ||
+           strCommand == NetMsgType::MASTERNODEPAYMENTSYNC ||
+           strCommand == NetMsgType::MASTERNODEPAYMENTVOTE ||
+           strCommand == NetMsgType::TXLOCKVOTE ||
+           strCommand == NetMsgType::MNGOVERNANCESYNC ||
+           strCommand == NetMsgType::MNGOVERNANCEOBJECT ||
+           strCommand == NetMsgType::MNGOVERNANCEOBJECTVOTE ||
+           strCommand == NetMsgType::MNGOVERNANCEVOTESYNC ||
+           strCommand == NetMsgType::MNGOVERNANCEVOTES;
+}
+
+void ProcessWorkerMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+{
+    try
+    {
+        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+        mnpayments.ProcessMessage(pfrom, strCommand, vRecv);
+        instantsend.ProcessMessage(pfrom, strCommand, vRecv);
+        governance.ProcessMessage(pfrom, strCommand, vRecv);
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        pfrom->PushMessage(NetMsgType::REJECT, strCommand, REJECT_MALFORMED, string("error parsing message"));
+        LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), vRecv.size(), e.what());
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -5761,7 +6194,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         CInv inv(nInvType, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
-        pfrom->setAskFor.erase(inv.hash);
+        pfrom->RemoveAskFor(inv.hash);
 
         // Process custom logic, no matter if tx will be accepted to mempool later or not
         if (strCommand == NetMsgType::TXLOCKREQUEST) {
@@ -5960,6 +6393,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // The proof of work dominates header validation; do it for the whole
+        // message in parallel, and before taking cs_main.
+        PrecomputeHeaderHashes(headers, chainparams.GetConsensus());
+
         LOCK(cs_main);
 
         if (nCount == 0) {
@@ -6322,6 +6759,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         if (found)
         {
+            // these don't have to wait for whoever holds cs_main, see ProcessWorkerMessage
+            if (IsWorkerMessage(strCommand) && QueueWorkerMessage(pfrom, strCommand, vRecv))
+                return true;
+
             //probably one the extensions
             darkSendPool.ProcessMessage(pfrom, strCommand, vRecv);
             mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
@@ -6341,6 +6782,67 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     return true;
 }
 
+/**
+ * Look ahead at the complete masternode messages queued for pfrom and hand
+ * their signatures to the signer recovery threads, so that by the time the
+ * messages are processed the expensive key recovery is usually cached.
+ */
+static void PrefetchMessageSigners(CNode* pfrom)
+{
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > vecMessages;
+
+    BOOST_FOREACH(CNetMessage& msg, pfrom->vRecvMsg) {
+        if (!msg.complete())
+            break;
+        if (msg.fSignersPrefetched)
+            continue;
+        msg.fSignersPrefetched = true;
+
+        std::string strCommand = msg.hdr.GetCommand();
+        if (strCommand != NetMsgType::MNANNOUNCE && strCommand != NetMsgType::MNPING &&
+            strCommand != NetMsgType::MASTERNODEPAYMENTVOTE && strCommand != NetMsgType::TXLOCKVOTE &&
+            strCommand != NetMsgType::MNGOVERNANCEOBJECTVOTE && strCommand != NetMsgType::MNGOVERNANCEVOTES)
+            continue;
+
+        try {
+            CDataStream vRecv(msg.vRecv.begin(), msg.vRecv.end(), msg.vRecv.GetType(), msg.vRecv.GetVersion());
+            if (strCommand == NetMsgType::MNANNOUNCE) {
+                CMasternodeBroadcast mnb;
+                vRecv >> mnb;
+                vecMessages.push_back(std::make_pair(mnb.GetSignatureMessage(), mnb.vchSig));
+                vecMessages.push_back(std::make_pair(mnb.lastPing.GetSignatureMessage(), mnb.lastPing.vchSig));
+            } else if (strCommand == NetMsgType::MNPING) {
+                CMasternodePing mnp;
+                vRecv >> mnp;
+                vecMessages.push_back(std::make_pair(mnp.GetSignatureMessage(), mnp.vchSig));
+            } else if (strCommand == NetMsgType::MASTERNODEPAYMENTVOTE) {
+                CMasternodePaymentVote vote;
+                vRecv >> vote;
+                vecMessages.push_back(std::make_pair(vote.GetSignatureMessage(), vote.vchSig));
+            } else if (strCommand == NetMsgType::TXLOCKVOTE) {
+                CTxLockVote vote;
+                vRecv >> vote;
+                // votes arriving after the quorum are dropped unverified, don't waste the workers on them
+                if (!instantsend.IsTxLockVoteRedundant(vote))
+                    vecMessages.push_back(std::make_pair(vote.GetSignatureMessage(), vote.GetSignature()));
+            } else if (strCommand == NetMsgType::MNGOVERNANCEVOTES) {
+                std::vector<CGovernanceVote> vecVotes;
+                vRecv >> vecVotes;
+                BOOST_FOREACH(const CGovernanceVote& vote, vecVotes)
+                    vecMessages.push_back(std::make_pair(vote.GetSignatureMessage(), vote.GetSignature()));
+            } else {
+                CGovernanceVote vote;
+                vRecv >> vote;
+                vecMessages.push_back(std::make_pair(vote.GetSignatureMessage(), vote.GetSignature()));
+            }
+        } catch (const std::exception&) {
+            // malformed messages are dealt with when they are processed
+        }
+    }
+
+    darkSendSigner.RecoverSignersAsync(vecMessages);
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -6364,12 +6866,18 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    PrefetchMessageSigners(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
             break;
 
+        // Leave the rest in the receive buffer while the message workers catch up with this peer
+        if (pfrom->nWorkerQueueSize >= ReceiveFloodSize())
+            break;
+
         // get next message
         CNetMessage& msg = *it;
 
@@ -6404,10 +6912,10 @@ bool ProcessMessages(CNode* pfrom)
         // Message size
         unsigned int nMessageSize = hdr.nMessageSize;
 
-        // Checksum
+        // Checksum, computed while the message was received
         CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
-        unsigned int nChecksum = ReadLE32((unsigned char*)&hash);
+        const uint256& hash = msg.GetMessageHash();
+        unsigned int nChecksum = ReadLE32(hash.begin());
         if (nChecksum != hdr.nChecksum)
         {
             LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n", __func__,
@@ -6504,6 +7012,8 @@ bool SendMessages(CNode* pto)
         if (!lockMain)
             return true;
 
+        ApplyPendingMisbehavior();
+
         // Address refresh broadcast
         int64_t nNow = GetTimeMicros();
         if (!IsInitialBlockDownload() && pto->nNextLocalAddrSend < nNow) {
@@ -6702,6 +7212,7 @@ bool SendMessages(CNode* pto)
         //
         vector<CInv> vInv;
         vector<CInv> vInvWait;
+        pto->PullRelayInventory();
         {
             bool fSendTrickle = pto->fWhitelisted;
             if (pto->nNextInvSend < nNow) {
@@ -6823,7 +7334,7 @@ bool SendMessages(CNode* pto)
             } else {
                 //If we're not going to ask, don't expect a response.
                 LogPrint("net", "SendMessages -- already have inv = %s peer=%d\n", inv.ToString(), pto->id);
-                pto->setAskFor.erase(inv.hash);
+                pto->RemoveAskFor(inv.hash);
             }
             pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
@@ -241,6 +241,30 @@ void CMasternodePayments::Clear()
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
     mapMasternodeBlocks.clear();
     mapMasternodePaymentVotes.clear();
+    mapMasternodePaymentVotesByHeight.clear();
+}
+
+// requires LOCK(cs_mapMasternodePaymentVotes)
+CMasternodePaymentVote& CMasternodePayments::StorePaymentVote(const CMasternodePaymentVote& vote)
+{
+    uint256 nHash = vote.GetHash();
+    std::pair<std::map<uint256, CMasternodePaymentVote>::iterator, bool> ret = mapMasternodePaymentVotes.insert(std::make_pair(nHash, vote));
+    if(ret.second) {
+        mapMasternodePaymentVotesByHeight[vote.nBlockHeight].push_back(nHash);
+    } else {
+        ret.first->second = vote;
+    }
+    return ret.first->second;
+}
+
+void CMasternodePayments::RebuildVoteIndex()
+{
+    mapMasternodePaymentVotesByHeight.clear();
+    std::map<uint256, CMasternodePaymentVote>::iterator it = mapMasternodePaymentVotes.begin();
+    while(it != mapMasternodePaymentVotes.end()) {
+        mapMasternodePaymentVotesByHeight[it->second.nBlockHeight].push_back(it->first);
+        ++it;
+    }
 }
 
 bool CMasternodePayments::CanVote(COutPoint outMasternode, int nBlockHeight)
@@ -343,7 +367,7 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
 
         uint256 nHash = vote.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         {
             LOCK(cs_mapMasternodePaymentVotes);
@@ -353,10 +377,9 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
             }
 
             // Avoid processing same vote multiple times
-            mapMasternodePaymentVotes[nHash] = vote;
             // but first mark vote as non-verified,
             // AddPaymentVote() below should take care of it if vote is actually ok
-            mapMasternodePaymentVotes[nHash].MarkAsNotVerified();
+            StorePaymentVote(vote).MarkAsNotVerified();
         }
 
         int nFirstBlock = pCurrentBlockIndex->nHeight - GetStorageLimit();
@@ -415,12 +438,17 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
     }
 }
 
+std::string CMasternodePaymentVote::GetSignatureMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+            boost::lexical_cast<std::string>(nBlockHeight) +
+            ScriptToAsmStr(payee);
+}
+
 bool CMasternodePaymentVote::Sign()
 {
     std::string strError;
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                boost::lexical_cast<std::string>(nBlockHeight) +
-                ScriptToAsmStr(payee);
+    std::string strMessage = GetSignatureMessage();
 
     if(!darkSendSigner.SignMessage(strMessage, vchSig, activeMasternode.keyMasternode)) {
         LogPrintf("CMasternodePaymentVote::Sign -- SignMessage() failed\n");
@@ -437,11 +465,8 @@ bool CMasternodePaymentVote::Sign()
 
 bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
 {
-    if(mapMasternodeBlocks.count(nBlockHeight)){
-        return mapMasternodeBlocks[nBlockHeight].GetBestPayee(payee);
-    }
-
-    return false;
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    return it != mapMasternodeBlocks.end() && it->second.GetBestPayee(payee);
 }
 
 // Is this masternode scheduled to get paid soon?
@@ -456,9 +481,10 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
 
     CScript payee;
-    for(int64_t h = pCurrentBlockIndex->nHeight; h <= pCurrentBlockIndex->nHeight + 8; h++){
-        if(h == nNotBlockHeight) continue;
-        if(mapMasternodeBlocks.count(h) && mapMasternodeBlocks[h].GetBestPayee(payee) && mnpayee == payee) {
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.lower_bound(pCurrentBlockIndex->nHeight);
+    for(; it != mapMasternodeBlocks.end() && it->first <= pCurrentBlockIndex->nHeight + 8; ++it) {
+        if(it->first == nNotBlockHeight) continue;
+        if(it->second.GetBestPayee(payee) && mnpayee == payee) {
             return true;
         }
     }
@@ -475,7 +501,7 @@ bool CMasternodePayments::AddPaymentVote(const CMasternodePaymentVote& vote)
 
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
-    mapMasternodePaymentVotes[vote.GetHash()] = vote;
+    StorePaymentVote(vote);
 
     if(!mapMasternodeBlocks.count(vote.nBlockHeight)) {
        CMasternodeBlockPayees blockPayees(vote.nBlockHeight);
@@ -639,18 +665,18 @@ void CMasternodePayments::CheckAndRemove()
 
     int nLimit = GetStorageLimit();
 
-    std::map<uint256, CMasternodePaymentVote>::iterator it = mapMasternodePaymentVotes.begin();
-    while(it != mapMasternodePaymentVotes.end()) {
-        CMasternodePaymentVote vote = (*it).second;
-
-        if(pCurrentBlockIndex->nHeight - vote.nBlockHeight > nLimit) {
-            LogPrint("mnpayments", "CMasternodePayments::CheckAndRemove -- Removing old Masternode payment: nBlockHeight=%d\n", vote.nBlockHeight);
-            mapMasternodePaymentVotes.erase(it++);
-            mapMasternodeBlocks.erase(vote.nBlockHeight);
-        } else {
-            ++it;
+    // drop whole heights below the storage limit, without looking at the votes we keep
+    std::map<int, std::vector<uint256> >::iterator itFirstKept = mapMasternodePaymentVotesByHeight.lower_bound(pCurrentBlockIndex->nHeight - nLimit);
+    std::map<int, std::vector<uint256> >::iterator it = mapMasternodePaymentVotesByHeight.begin();
+    while(it != itFirstKept) {
+        LogPrint("mnpayments", "CMasternodePayments::CheckAndRemove -- Removing old Masternode payments: nBlockHeight=%d, votes=%d\n", it->first, it->second.size());
+        BOOST_FOREACH(const uint256& hash, it->second) {
+            mapMasternodePaymentVotes.erase(hash);
         }
+        mapMasternodeBlocks.erase(it->first);
+        mapMasternodePaymentVotesByHeight.erase(it++);
     }
+    mapMasternodeBlocks.erase(mapMasternodeBlocks.begin(), mapMasternodeBlocks.lower_bound(pCurrentBlockIndex->nHeight - nLimit));
     LogPrintf("CMasternodePayments::CheckAndRemove -- %s\n", ToString());
 }
 
@@ -789,9 +815,7 @@ bool CMasternodePaymentVote::CheckSignature(const CPubKey& pubKeyMasternode, int
     // do not ban by default
     nDos = 0;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                boost::lexical_cast<std::string>(nBlockHeight) +
-                ScriptToAsmStr(payee);
+    std::string strMessage = GetSignatureMessage();
 
     std::string strError = "";
     if (!darkSendSigner.VerifyMessage(pubKeyMasternode, vchSig, strMessage, strError)) {
@@ -822,22 +846,20 @@ std::string CMasternodePaymentVote::ToString() const
 // Send only votes for future blocks, node should request every other missing payment block individually
 void CMasternodePayments::Sync(CNode* pnode)
 {
-    LOCK(cs_mapMasternodeBlocks);
+    LOCK(cs_mapMasternodePaymentVotes);
 
     if(!pCurrentBlockIndex) return;
 
     int nInvCount = 0;
 
-    for(int h = pCurrentBlockIndex->nHeight; h < pCurrentBlockIndex->nHeight + 20; h++) {
-        if(mapMasternodeBlocks.count(h)) {
-            BOOST_FOREACH(CMasternodePayee& payee, mapMasternodeBlocks[h].vecPayees) {
-                std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
-                BOOST_FOREACH(uint256& hash, vecVoteHashes) {
-                    if(!HasVerifiedPaymentVote(hash)) continue;
-                    pnode->PushInventory(CInv(MSG_MASTERNODE_PAYMENT_VOTE, hash));
-                    nInvCount++;
-                }
-            }
+    std::map<int, std::vector<uint256> >::iterator it = mapMasternodePaymentVotesByHeight.lower_bound(pCurrentBlockIndex->nHeight);
+    std::map<int, std::vector<uint256> >::iterator itEnd = mapMasternodePaymentVotesByHeight.lower_bound(pCurrentBlockIndex->nHeight + 20);
+    for(; it != itEnd; ++it) {
+        BOOST_FOREACH(const uint256& hash, it->second) {
+            std::map<uint256, CMasternodePaymentVote>::iterator itVote = mapMasternodePaymentVotes.find(hash);
+            if(itVote == mapMasternodePaymentVotes.end() || !itVote->second.IsVerified()) continue;
+            pnode->PushInventory(CInv(MSG_MASTERNODE_PAYMENT_VOTE, hash));
+            nInvCount++;
         }
     }
 
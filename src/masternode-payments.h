@@ -29,7 +29,7 @@ static const int MIN_MASTERNODE_PAYMENT_PROTO_VERSION_2 = 70206;
 
 extern CCriticalSection cs_vecPayees;
 extern CCriticalSection cs_mapMasternodeBlocks;
-extern CCriticalSection cs_mapMasternodePayeeVotes;
+extern CCriticalSection cs_mapMasternodePaymentVotes;
 
 extern CMasternodePayments mnpayments;
 
@@ -148,6 +148,8 @@ public:
         return ss.GetHash();
     }
 
+    /// The message covered by vchSig
+    std::string GetSignatureMessage() const;
     bool Sign();
     bool CheckSignature(const CPubKey& pubKeyMasternode, int nValidationHeight, int &nDos);
 
@@ -176,6 +178,12 @@ private:
     // Keep track of current block index
     const CBlockIndex *pCurrentBlockIndex;
 
+    // vote hashes by block height, so that whole heights can be synced and dropped at once
+    std::map<int, std::vector<uint256> > mapMasternodePaymentVotesByHeight;
+
+    CMasternodePaymentVote& StorePaymentVote(const CMasternodePaymentVote& vote);
+    void RebuildVoteIndex();
+
 public:
     std::map<uint256, CMasternodePaymentVote> mapMasternodePaymentVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -189,6 +197,21 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(mapMasternodePaymentVotes);
         READWRITE(mapMasternodeBlocks);
+        if(ser_action.ForRead()) {
+            RebuildVoteIndex();
+        }
+    }
+
+    /// Same content as SerializationOp, laid out as CFlatJournalDB records
+    template <typename Journal>
+    void JournalOp(Journal& journal) {
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
+        journal.Map(0, mapMasternodePaymentVotes);
+        journal.Map(1, mapMasternodeBlocks);
+        journal.Commit();
+        if(journal.ForRead()) {
+            RebuildVoteIndex();
+        }
     }
 
     void Clear();
@@ -15,6 +15,7 @@
 class CMasternode;
 class CMasternodeBroadcast;
 class CMasternodePing;
+class CMasternodePaidBlocks;
 
 static const int MASTERNODE_CHECK_SECONDS               =   5;
 static const int MASTERNODE_MIN_MNB_SECONDS             =   5 * 60;
@@ -79,6 +80,8 @@ public:
 
     bool IsExpired() { return GetTime() - sigTime > MASTERNODE_NEW_START_REQUIRED_SECONDS; }
 
+    /// The message covered by vchSig
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool CheckSignature(CPubKey& pubKeyMasternode, int &nDos);
     bool SimpleCheck(int& nDos);
@@ -307,7 +310,7 @@ public:
 
     int GetLastPaidTime() { return nTimeLastPaid; }
     int GetLastPaidBlock() { return nBlockLastPaid; }
-    void UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBack);
+    void UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBack, const CMasternodePaidBlocks& paidBlocks);
 
     // KEEP TRACK OF EACH GOVERNANCE ITEM INCASE THIS NODE GOES OFFLINE, SO WE CAN RECALC THEIR STATUS
     void AddGovernanceVote(uint256 nGovernanceObjectHash);
@@ -381,6 +384,8 @@ public:
     bool Update(CMasternode* pmn, int& nDos);
     bool CheckOutpoint(int& nDos);
 
+    /// The message covered by vchSig
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyCollateralAddress);
     bool CheckSignature(int& nDos);
     void Relay();
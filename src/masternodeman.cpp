@@ -79,6 +79,99 @@ void CMasternodeIndex::Clear()
     mapReverseIndex.clear();
     nSize = 0;
 }
+
+CMasternodePaidBlocks::CMasternodePaidBlocks()
+    : mapBlocks(),
+      mapPayeeHeights()
+{}
+
+void CMasternodePaidBlocks::Update(const CBlockIndex* pindex, int nDepth)
+{
+    if(!pindex) return;
+
+    // Undo blocks that are no longer part of the active chain, highest first.
+    // Once an indexed block matches the chain, every block below it does too.
+    while(!mapBlocks.empty()) {
+        block_m_it it = --mapBlocks.end();
+        const CBlockIndex* pindexAtHeight = pindex->GetAncestor(it->first);
+        if(pindexAtHeight && pindexAtHeight->GetBlockHash() == it->second.hashBlock) {
+            break;
+        }
+        EraseBlock(it);
+    }
+
+    int nFirstHeight = std::max(0, pindex->nHeight - nDepth + 1);
+
+    // Prune blocks that fell out of the window
+    while(!mapBlocks.empty() && mapBlocks.begin()->first < nFirstHeight) {
+        EraseBlock(mapBlocks.begin());
+    }
+
+    int nHeight = mapBlocks.empty() ? nFirstHeight : std::max(nFirstHeight, mapBlocks.rbegin()->first + 1);
+    for(; nHeight <= pindex->nHeight; ++nHeight) {
+        AddBlock(pindex->GetAncestor(nHeight));
+    }
+}
+
+const std::set<int>* CMasternodePaidBlocks::GetPaidHeights(const CScript& payee) const
+{
+    payee_m_cit it = mapPayeeHeights.find(payee);
+    if(it == mapPayeeHeights.end()) {
+        return NULL;
+    }
+    return &it->second;
+}
+
+uint32_t CMasternodePaidBlocks::GetBlockTime(int nHeight) const
+{
+    block_m_cit it = mapBlocks.find(nHeight);
+    if(it == mapBlocks.end()) {
+        return 0;
+    }
+    return it->second.nTime;
+}
+
+void CMasternodePaidBlocks::Clear()
+{
+    mapBlocks.clear();
+    mapPayeeHeights.clear();
+}
+
+void CMasternodePaidBlocks::AddBlock(const CBlockIndex* pindex)
+{
+    paid_block_t& paidBlock = mapBlocks[pindex->nHeight];
+    paidBlock.hashBlock = pindex->GetBlockHash();
+    paidBlock.nTime = pindex->nTime;
+
+    CBlock block;
+    if(!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) { // shouldn't really happen
+        LogPrintf("CMasternodePaidBlocks::AddBlock -- failed to read block %s at height %d\n", pindex->GetBlockHash().ToString(), pindex->nHeight);
+        return;
+    }
+
+    CAmount nMasternodePayment = GetMasternodePayment(pindex->nHeight, block.vtx[0].GetValueOut());
+
+    BOOST_FOREACH(const CTxOut& txout, block.vtx[0].vout) {
+        if(txout.nValue == nMasternodePayment) {
+            paidBlock.vecPayees.push_back(txout.scriptPubKey);
+            mapPayeeHeights[txout.scriptPubKey].insert(pindex->nHeight);
+        }
+    }
+}
+
+void CMasternodePaidBlocks::EraseBlock(block_m_it it)
+{
+    BOOST_FOREACH(const CScript& payee, it->second.vecPayees) {
+        payee_m_it itPayee = mapPayeeHeights.find(payee);
+        if(itPayee == mapPayeeHeights.end()) continue;
+        itPayee->second.erase(it->first);
+        if(itPayee->second.empty()) {
+            mapPayeeHeights.erase(itPayee);
+        }
+    }
+    mapBlocks.erase(it);
+}
+
 struct CompareByAddr
 
 {
@@ -100,6 +193,10 @@ void CMasternodeIndex::RebuildIndex()
 CMasternodeMan::CMasternodeMan()
 : cs(),
   vMasternodes(),
+  mapOutpointPos(),
+  mapPubKeyMasternodePos(),
+  mapPubKeyCollateralPos(),
+  mapRankTables(MAX_RANK_TABLES),
   mAskedUsForMasternodeList(),
   mWeAskedForMasternodeList(),
   mWeAskedForMasternodeListEntry(),
@@ -128,6 +225,8 @@ bool CMasternodeMan::Add(CMasternode &mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        AddToLookupIndexes(vMasternodes.size() - 1);
+        mapRankTables.Clear();
         indexMasternodes.AddMasternodeVIN(mn.vin);
         fMasternodesAdded = true;
         return true;
@@ -194,6 +293,7 @@ void CMasternodeMan::CheckAndRemove()
         std::vector<std::pair<int, CMasternode> > vecMasternodeRanks;
         // ask for up to MNB_RECOVERY_MAX_ASK_ENTRIES masternode entries at a time
         int nAskForMnbRecovery = MNB_RECOVERY_MAX_ASK_ENTRIES;
+        bool fErased = false;
         while(it != vMasternodes.end()) {
             CMasternodeBroadcast mnb = CMasternodeBroadcast(*it);
             uint256 hash = mnb.GetHash();
@@ -209,6 +309,9 @@ void CMasternodeMan::CheckAndRemove()
                 it->FlagGovernanceItemsAsDirty();
                 it = vMasternodes.erase(it);
                 fMasternodesRemoved = true;
+                fErased = true;
+                // GetMasternodeRanks() below must not use positions from before the erase
+                mapRankTables.Clear();
             } else {
                 bool fAsk = pCurrentBlockIndex &&
                             (nAskForMnbRecovery > 0) &&
@@ -245,6 +348,11 @@ void CMasternodeMan::CheckAndRemove()
             }
         }
 
+        // positions have shifted, lookups below must see the new ones
+        if(fErased) {
+            RebuildLookupIndexes();
+        }
+
         // proces replies for MASTERNODE_NEW_START_REQUIRED masternodes
         LogPrint("masternode", "CMasternodeMan::CheckAndRemove -- mMnbRecoveryGoodReplies size=%d\n", (int)mMnbRecoveryGoodReplies.size());
         std::map<uint256, std::vector<CMasternodeBroadcast> >::iterator itMnbReplies = mMnbRecoveryGoodReplies.begin();
@@ -368,6 +476,10 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapOutpointPos.clear();
+    mapPubKeyMasternodePos.clear();
+    mapPubKeyCollateralPos.clear();
+    mapRankTables.Clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -377,6 +489,7 @@ void CMasternodeMan::Clear()
     nLastWatchdogVoteTime = 0;
     indexMasternodes.Clear();
     indexMasternodesOld.Clear();
+    paidBlocks.Clear();
 }
 
 int CMasternodeMan::CountMasternodes(int nProtocolVersion)
@@ -449,11 +562,18 @@ CMasternode* CMasternodeMan::Find(const CScript &payee)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()) == payee)
-            return &mn;
-    }
+    // masternodes are only ever paid to the P2PKH script of their collateral key
+    if(!payee.IsPayToPublicKeyHash())
+        return NULL;
+
+    CKeyID keyID(uint160(std::vector<unsigned char>(payee.begin() + 3, payee.begin() + 23)));
+    keyid_pos_m_cit it = mapPubKeyCollateralPos.find(keyID);
+    if(it == mapPubKeyCollateralPos.end())
+        return NULL;
+
+    CMasternode& mn = vMasternodes[it->second];
+    if(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()) == payee)
+        return &mn;
     return NULL;
 }
 
@@ -461,11 +581,13 @@ CMasternode* CMasternodeMan::Find(const CTxIn &vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
+    outpoint_pos_m_cit it = mapOutpointPos.find(vin.prevout);
+    if(it == mapOutpointPos.end())
+        return NULL;
+
+    CMasternode& mn = vMasternodes[it->second];
+    if(mn.vin.prevout == vin.prevout)
+        return &mn;
     return NULL;
 }
 
@@ -473,14 +595,38 @@ CMasternode* CMasternodeMan::Find(const CPubKey &pubKeyMasternode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
+    keyid_pos_m_cit it = mapPubKeyMasternodePos.find(pubKeyMasternode.GetID());
+    if(it == mapPubKeyMasternodePos.end())
+        return NULL;
+
+    CMasternode& mn = vMasternodes[it->second];
+    if(mn.pubKeyMasternode == pubKeyMasternode)
+        return &mn;
     return NULL;
 }
 
+void CMasternodeMan::AddToLookupIndexes(size_t nPos)
+{
+    const CMasternode& mn = vMasternodes[nPos];
+    // insert() keeps an existing entry, so the first masternode with a given key wins like the linear scan did
+    mapOutpointPos.insert(std::make_pair(mn.vin.prevout, nPos));
+    mapPubKeyMasternodePos.insert(std::make_pair(mn.pubKeyMasternode.GetID(), nPos));
+    mapPubKeyCollateralPos.insert(std::make_pair(mn.pubKeyCollateralAddress.GetID(), nPos));
+}
+
+void CMasternodeMan::RebuildLookupIndexes()
+{
+    LOCK(cs);
+    mapOutpointPos.clear();
+    mapPubKeyMasternodePos.clear();
+    mapPubKeyCollateralPos.clear();
+    for(size_t i = 0; i < vMasternodes.size(); ++i) {
+        AddToLookupIndexes(i);
+    }
+    // positions are stale too
+    mapRankTables.Clear();
+}
+
 bool CMasternodeMan::Get(const CPubKey& pubKeyMasternode, CMasternode& masternode)
 {
     // Theses mutexes are recursive so double locking by the same thread is safe.
@@ -655,36 +801,68 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(const std::vector<CTxIn> &vecToE
     return NULL;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int nBlockHeight, int nMinProtocol, bool fOnlyActive)
+CMasternodeMan::rank_table_sptr CMasternodeMan::GetRankTable(int nBlockHeight, const uint256& blockHash, int nMinProtocol)
 {
+    LOCK(cs);
+
+    std::pair<int,int> key = std::make_pair(nBlockHeight, nMinProtocol);
+    rank_table_sptr pTable;
+    // the block at this height could have been reorganized away since the table was built
+    if(mapRankTables.Get(key, pTable) && pTable->blockHash == blockHash) {
+        return pTable;
+    }
+
     std::vector<std::pair<int64_t, CMasternode*> > vecMasternodeScores;
 
+    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+        if(mn.nProtocolVersion < nMinProtocol) continue;
+
+        int64_t nScore = mn.CalculateScore(blockHash).GetCompact(false);
+
+        vecMasternodeScores.push_back(std::make_pair(nScore, &mn));
+    }
+
+    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+
+    rank_table_t* pNewTable = new rank_table_t();
+    pNewTable->blockHash = blockHash;
+    pNewTable->vecPos.reserve(vecMasternodeScores.size());
+    BOOST_FOREACH(PAIRTYPE(int64_t, CMasternode*)& scorePair, vecMasternodeScores) {
+        pNewTable->vecPos.push_back(scorePair.second - &vMasternodes[0]);
+    }
+
+    pTable.reset(pNewTable);
+    mapRankTables.Insert(key, pTable);
+    return pTable;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int nBlockHeight, int nMinProtocol, bool fOnlyActive)
+{
     //make sure we know about this block
     uint256 blockHash = uint256();
     if(!GetBlockHash(blockHash, nBlockHeight)) return -1;
 
     LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        if(mn.nProtocolVersion < nMinProtocol) continue;
+    // no need to look at the ranks of others if this one isn't ranked at all
+    CMasternode* pmn = Find(vin);
+    if(!pmn || pmn->nProtocolVersion < nMinProtocol) return -1;
+    if(fOnlyActive ? !pmn->IsEnabled() : !pmn->IsValidForPayment()) return -1;
+
+    // masternode states change outside of the manager, so they are applied on top of the cached order
+    rank_table_sptr pTable = GetRankTable(nBlockHeight, blockHash, nMinProtocol);
+
+    int nRank = 0;
+    BOOST_FOREACH(size_t nPos, pTable->vecPos) {
+        CMasternode& mn = vMasternodes[nPos];
         if(fOnlyActive) {
             if(!mn.IsEnabled()) continue;
         }
         else {
             if(!mn.IsValidForPayment()) continue;
         }
-        int64_t nScore = mn.CalculateScore(blockHash).GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(nScore, &mn));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int nRank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode*)& scorePair, vecMasternodeScores) {
         nRank++;
-        if(scorePair.second->vin.prevout == vin.prevout) return nRank;
+        if(&mn == pmn) return nRank;
     }
 
     return -1;
@@ -692,7 +870,6 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int nBlockHeight, int nM
 
 std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int nBlockHeight, int nMinProtocol)
 {
-    std::vector<std::pair<int64_t, CMasternode*> > vecMasternodeScores;
     std::vector<std::pair<int, CMasternode> > vecMasternodeRanks;
 
     //make sure we know about this block
@@ -701,22 +878,14 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
 
     LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-
-        if(mn.nProtocolVersion < nMinProtocol || !mn.IsEnabled()) continue;
-
-        int64_t nScore = mn.CalculateScore(blockHash).GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(nScore, &mn));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+    rank_table_sptr pTable = GetRankTable(nBlockHeight, blockHash, nMinProtocol);
 
     int nRank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode*)& s, vecMasternodeScores) {
+    BOOST_FOREACH(size_t nPos, pTable->vecPos) {
+        CMasternode& mn = vMasternodes[nPos];
+        if(!mn.IsEnabled()) continue;
         nRank++;
-        vecMasternodeRanks.push_back(std::make_pair(nRank, *s.second));
+        vecMasternodeRanks.push_back(std::make_pair(nRank, mn));
     }
 
     return vecMasternodeRanks;
@@ -724,34 +893,23 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int nBlockHeight, int nMinProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CMasternode*> > vecMasternodeScores;
-
-    LOCK(cs);
-
     uint256 blockHash;
     if(!GetBlockHash(blockHash, nBlockHeight)) {
         LogPrintf("CMasternode::GetMasternodeByRank -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", nBlockHeight);
         return NULL;
     }
 
-    // Fill scores
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-
-        if(mn.nProtocolVersion < nMinProtocol) continue;
-        if(fOnlyActive && !mn.IsEnabled()) continue;
-
-        int64_t nScore = mn.CalculateScore(blockHash).GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(nScore, &mn));
-    }
+    LOCK(cs);
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+    rank_table_sptr pTable = GetRankTable(nBlockHeight, blockHash, nMinProtocol);
 
     int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode*)& s, vecMasternodeScores){
+    BOOST_FOREACH(size_t nPos, pTable->vecPos) {
+        CMasternode& mn = vMasternodes[nPos];
+        if(fOnlyActive && !mn.IsEnabled()) continue;
         rank++;
         if(rank == nRank) {
-            return s.second;
+            return &mn;
         }
     }
 
@@ -811,7 +969,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CMasternodeBroadcast mnb;
         vRecv >> mnb;
 
-        pfrom->setAskFor.erase(mnb.GetHash());
+        pfrom->RemoveAskFor(mnb.GetHash());
 
         LogPrint("masternode", "MNANNOUNCE -- Masternode announce, masternode=%s\n", mnb.vin.prevout.ToStringShort());
 
@@ -834,7 +992,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
         uint256 nHash = mnp.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         LogPrint("masternode", "MNPING -- Masternode ping, masternode=%s\n", mnp.vin.prevout.ToStringShort());
 
@@ -1393,9 +1551,14 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
         }
     } else {
         CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
+        CPubKey pubKeyMasternodeOld = pmn->pubKeyMasternode;
         if(pmn->UpdateFromNewBroadcast(mnb)) {
             masternodeSync.AddedMasternodeList();
             mapSeenMasternodeBroadcast.erase(mnbOld.GetHash());
+            if(pmn->pubKeyMasternode != pubKeyMasternodeOld) {
+                RebuildLookupIndexes();
+            }
+            mapRankTables.Clear();
         }
     }
 }
@@ -1453,7 +1616,16 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
     CMasternode* pmn = Find(mnb.vin);
     if(pmn) {
         CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
-        if(!mnb.Update(pmn, nDos)) {
+        CPubKey pubKeyMasternodeOld = pmn->pubKeyMasternode;
+        int nProtocolVersionOld = pmn->nProtocolVersion;
+        bool fUpdated = mnb.Update(pmn, nDos);
+        if(pmn->pubKeyMasternode != pubKeyMasternodeOld) {
+            RebuildLookupIndexes();
+        }
+        if(pmn->nProtocolVersion != nProtocolVersionOld) {
+            mapRankTables.Clear();
+        }
+        if(!fUpdated) {
             LogPrint("masternode", "CMasternodeMan::CheckMnbAndUpdateMasternodeList -- Update() failed, masternode=%s\n", mnb.vin.prevout.ToStringShort());
             return false;
         }
@@ -1504,8 +1676,11 @@ void CMasternodeMan::UpdateLastPaid()
     // LogPrint("mnpayments", "CMasternodeMan::UpdateLastPaid -- nHeight=%d, nMaxBlocksToScanBack=%d, IsFirstRun=%s\n",
     //                         pCurrentBlockIndex->nHeight, nMaxBlocksToScanBack, IsFirstRun ? "true" : "false");
 
+    // Usually a no-op, UpdatedBlockTip keeps the index in sync
+    paidBlocks.Update(pCurrentBlockIndex, mnpayments.GetStorageLimit());
+
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        mn.UpdateLastPaid(pCurrentBlockIndex, nMaxBlocksToScanBack);
+        mn.UpdateLastPaid(pCurrentBlockIndex, nMaxBlocksToScanBack, paidBlocks);
     }
 
     // every time is like the first time if winners list is not synced
@@ -1639,6 +1814,7 @@ void CMasternodeMan::SetMasternodeLastPing(const CTxIn& vin, const CMasternodePi
     uint256 hash = mnb.GetHash();
     if(mapSeenMasternodeBroadcast.count(hash)) {
         mapSeenMasternodeBroadcast[hash].second.lastPing = mnp;
+        EraseRelayMessageCache(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
     }
 }
 
@@ -1647,6 +1823,16 @@ void CMasternodeMan::UpdatedBlockTip(const CBlockIndex *pindex)
     pCurrentBlockIndex = pindex;
     LogPrint("masternode", "CMasternodeMan::UpdatedBlockTip -- pCurrentBlockIndex->nHeight=%d\n", pCurrentBlockIndex->nHeight);
 
+    {
+        LOCK(cs);
+        mapRankTables.Clear();
+    }
+
+    if(!fLiteMode) {
+        LOCK(cs);
+        paidBlocks.Update(pindex, mnpayments.GetStorageLimit());
+    }
+
     CheckSameAddr();
 
     if(fMasterNode) {
@@ -6,9 +6,13 @@
 #ifndef MASTERNODEMAN_H
 #define MASTERNODEMAN_H
 
+#include "cachemap.h"
 #include "masternode.h"
 #include "sync.h"
 
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
 using namespace std;
 
 class CMasternodeMan;
@@ -79,6 +83,73 @@ private:
 
 };
 
+/**
+ * Records which scripts were paid the masternode reward by the coinbase of the
+ * most recent blocks of the active chain.
+ *
+ * The index is kept in line with the chain incrementally: entries for blocks that
+ * are no longer part of the active chain are undone and every newly connected
+ * block is read from disk once, so looking up when a masternode was last paid
+ * no longer requires rescanning blocks for each masternode.
+ */
+class CMasternodePaidBlocks
+{
+public: // Types
+    struct paid_block_t
+    {
+        uint256 hashBlock;
+        uint32_t nTime;
+        std::vector<CScript> vecPayees;
+    };
+
+    typedef std::map<int,paid_block_t> block_m_t;
+
+    typedef block_m_t::iterator block_m_it;
+
+    typedef block_m_t::const_iterator block_m_cit;
+
+    typedef std::map<CScript,std::set<int> > payee_m_t;
+
+    typedef payee_m_t::iterator payee_m_it;
+
+    typedef payee_m_t::const_iterator payee_m_cit;
+
+private:
+    block_m_t            mapBlocks;
+
+    payee_m_t            mapPayeeHeights;
+
+public:
+    CMasternodePaidBlocks();
+
+    /// Sync with the active chain ending at pindex, keeping at most nDepth blocks
+    void Update(const CBlockIndex* pindex, int nDepth);
+
+    /// Heights of the indexed blocks that paid payee, NULL if there are none
+    const std::set<int>* GetPaidHeights(const CScript& payee) const;
+
+    /// Block time of an indexed height, 0 if the height isn't indexed
+    uint32_t GetBlockTime(int nHeight) const;
+
+    void Clear();
+
+private:
+    void AddBlock(const CBlockIndex* pindex);
+
+    void EraseBlock(block_m_it it);
+
+};
+
+struct MasternodeOutPointHasher
+{
+    size_t operator()(const COutPoint& outpoint) const { return outpoint.hash.GetCheapHash() ^ outpoint.n; }
+};
+
+struct MasternodeKeyIDHasher
+{
+    size_t operator()(const CKeyID& keyID) const { return ReadLE64(keyID.begin()); }
+};
+
 class CMasternodeMan
 {
 public:
@@ -88,6 +159,27 @@ public:
 
     typedef index_m_t::const_iterator index_m_cit;
 
+    /// Lookup indexes map a key to the position in vMasternodes of the first masternode with that key
+    typedef boost::unordered_map<COutPoint,size_t,MasternodeOutPointHasher> outpoint_pos_m_t;
+
+    typedef outpoint_pos_m_t::const_iterator outpoint_pos_m_cit;
+
+    typedef boost::unordered_map<CKeyID,size_t,MasternodeKeyIDHasher> keyid_pos_m_t;
+
+    typedef keyid_pos_m_t::const_iterator keyid_pos_m_cit;
+
+    /// Positions in vMasternodes of the masternodes meeting a minimum protocol version, best score for a block first
+    struct rank_table_t
+    {
+        uint256 blockHash;
+        std::vector<size_t> vecPos;
+    };
+
+    typedef boost::shared_ptr<const rank_table_t> rank_table_sptr;
+
+    /// Rank tables are cached by (block height, min protocol)
+    typedef CacheMap<std::pair<int,int>,rank_table_sptr> rank_table_cache_t;
+
 private:
     static const int MAX_EXPECTED_INDEX_SIZE = 30000;
 
@@ -100,6 +192,8 @@ private:
 
     static const int LAST_PAID_SCAN_BLOCKS      = 100;
 
+    static const int MAX_RANK_TABLES            = 16;
+
     static const int MIN_POSE_PROTO_VERSION     = 70203;
     static const int MAX_POSE_CONNECTIONS       = 10;
     static const int MAX_POSE_RANK              = 10;
@@ -120,6 +214,14 @@ private:
 
     // map to hold all MNs
     std::vector<CMasternode> vMasternodes;
+    // lookup indexes into vMasternodes by collateral outpoint, masternode key and collateral key,
+    // must be rebuilt whenever masternodes are removed or a masternode key changes
+    outpoint_pos_m_t mapOutpointPos;
+    keyid_pos_m_t mapPubKeyMasternodePos;
+    keyid_pos_m_t mapPubKeyCollateralPos;
+    // score ordered masternodes for recently requested blocks, must be cleared whenever
+    // the tip, the set of masternodes or their protocol versions change
+    rank_table_cache_t mapRankTables;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -140,6 +242,8 @@ private:
 
     CMasternodeIndex indexMasternodesOld;
 
+    CMasternodePaidBlocks paidBlocks;
+
     /// Set when index has been rebuilt, clear when read
     bool fIndexRebuilt;
 
@@ -155,6 +259,12 @@ private:
 
     friend class CMasternodeSync;
 
+    void AddToLookupIndexes(size_t nPos);
+    void RebuildLookupIndexes();
+
+    /// Get the (cached) rank table for a block, nBlockHeight must be the height of blockHash
+    rank_table_sptr GetRankTable(int nBlockHeight, const uint256& blockHash, int nMinProtocol);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, std::pair<int64_t, CMasternodeBroadcast> > mapSeenMasternodeBroadcast;
@@ -192,11 +302,43 @@ public:
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
         READWRITE(indexMasternodes);
+        if(ser_action.ForRead()) {
+            RebuildLookupIndexes();
+        }
         if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
     }
 
+    /// Same content as SerializationOp, laid out as CFlatJournalDB records
+    template <typename Journal>
+    void JournalOp(Journal& journal) {
+        LOCK(cs);
+        std::string strVersion;
+        if(!journal.ForRead()) {
+            strVersion = SERIALIZATION_VERSION_STRING;
+        }
+        journal.Value(0, strVersion);
+        journal.Value(1, vMasternodes);
+        journal.Value(2, mAskedUsForMasternodeList);
+        journal.Value(3, mWeAskedForMasternodeList);
+        journal.Value(4, mWeAskedForMasternodeListEntry);
+        journal.Value(5, mMnbRecoveryRequests);
+        journal.Value(6, mMnbRecoveryGoodReplies);
+        journal.Value(7, nLastWatchdogVoteTime);
+        journal.Value(8, nDsqCount);
+        journal.Map(9, mapSeenMasternodeBroadcast);
+        journal.Map(10, mapSeenMasternodePing);
+        journal.Value(11, indexMasternodes);
+        journal.Commit();
+        if(journal.ForRead()) {
+            RebuildLookupIndexes();
+        }
+        if(journal.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
+            Clear();
+        }
+    }
+
     CMasternodeMan();
 
     /// Add an entry
@@ -34,6 +34,11 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -92,6 +97,8 @@ uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
 int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
+bool fSocketEventsEpoll = false;
+int nMessageWorkers = DEFAULT_MESSAGE_WORKERS;
 bool fAddressesInitialized = false;
 std::string strSubVersion;
 
@@ -100,6 +107,29 @@ CCriticalSection cs_vNodes;
 map<CInv, CDataStream> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
+
+namespace {
+    struct CRelayInvEntry
+    {
+        int64_t nTime;
+        int nMinProtoVersion;
+        CInv inv;
+
+        CRelayInvEntry(int64_t nTimeIn, int nMinProtoVersionIn, const CInv& invIn) :
+            nTime(nTimeIn), nMinProtoVersion(nMinProtoVersionIn), inv(invIn) {}
+    };
+}
+
+// Items relayed with RelayInv, which every peer pulls from here. The sequence
+// number of an entry is its position counted from the first item ever relayed.
+static deque<CRelayInvEntry> vRelayInvQueue;
+static uint64_t nRelayInvQueueEnd = 0; // sequence number after the last entry
+static CCriticalSection cs_vRelayInvQueue;
+
+static map<CInv, CSendBufferRef> mapRelayMessageCache;
+static deque<pair<int64_t, CInv> > vRelayMessageCacheExpiration;
+static size_t nRelayMessageCacheSize = 0;
+static CCriticalSection cs_mapRelayMessageCache;
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
 static deque<string> vOneShots;
@@ -388,6 +418,119 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+//
+// Socket events: ThreadSocketHandler either builds fd_sets for select() on
+// every pass, or keeps every socket registered with an edge-triggered epoll
+// instance for as long as its CNode is connected.
+//
+
+/** Time ThreadSocketHandler waits for socket events, in milliseconds */
+static const int SOCKET_EVENTS_INTERVAL = 50;
+
+#ifdef USE_EPOLL
+/** Maximum number of events taken from the epoll instance at once */
+static const int MAX_SOCKET_EVENTS = 256;
+
+static int hEpollFd = -1;
+/** eventfd that wakes up the socket handler when a send queue got filled */
+static int hWakeupFd = -1;
+/** Nodes with queued data to send, referenced until the socket handler takes them */
+static std::vector<CNode*> vNodesSendWakeup;
+static CCriticalSection cs_vNodesSendWakeup;
+#endif
+
+std::string GetSupportedSocketEvents()
+{
+#ifdef USE_EPOLL
+    return "epoll, select";
+#else
+    return "select";
+#endif
+}
+
+/** select() can only watch descriptors below FD_SETSIZE */
+static bool IsServiceableSocket(SOCKET hSocket)
+{
+    return fSocketEventsEpoll || IsSelectableSocket(hSocket);
+}
+
+static void SocketEventsInit()
+{
+#ifdef USE_EPOLL
+    if (!fSocketEventsEpoll)
+        return;
+
+    hEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpollFd != -1)
+        hWakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    bool fSuccess = hEpollFd != -1 && hWakeupFd != -1;
+    if (fSuccess) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        fSuccess = epoll_ctl(hEpollFd, EPOLL_CTL_ADD, hWakeupFd, &event) == 0;
+        // listen sockets stay level-triggered, we accept one connection per event
+        BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket) {
+            event.data.ptr = &hListenSocket;
+            fSuccess = fSuccess && epoll_ctl(hEpollFd, EPOLL_CTL_ADD, hListenSocket.socket, &event) == 0;
+        }
+    }
+
+    if (!fSuccess) {
+        LogPrintf("Failed to set up epoll, falling back to select(): %s\n", NetworkErrorString(errno));
+        if (hWakeupFd != -1)
+            close(hWakeupFd);
+        if (hEpollFd != -1)
+            close(hEpollFd);
+        hWakeupFd = hEpollFd = -1;
+        fSocketEventsEpoll = false;
+    }
+#endif
+}
+
+static void SocketEventsAdd(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (!fSocketEventsEpoll)
+        return;
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpollFd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl() failed for peer=%d: %s\n", pnode->id, NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
+static void SocketEventsRemove(SOCKET hSocket)
+{
+#ifdef USE_EPOLL
+    if (fSocketEventsEpoll)
+        epoll_ctl(hEpollFd, EPOLL_CTL_DEL, hSocket, NULL);
+#endif
+}
+
+/** Have the socket handler send what is left in pnode's send queue */
+static void WakeupSocketHandler(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (!fSocketEventsEpoll)
+        return;
+
+    {
+        LOCK(cs_vNodesSendWakeup);
+        pnode->AddRef();
+        vNodesSendWakeup.push_back(pnode);
+    }
+    uint64_t nSignal = 1;
+    if (write(hWakeupFd, &nSignal, sizeof(nSignal)) != sizeof(nSignal))
+        LogPrint("net", "socket handler wakeup failed: %s\n", NetworkErrorString(errno));
+#endif
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fConnectToMasternode)
 {
     if (pszDest == NULL) {
@@ -422,7 +565,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fConnectToMas
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsServiceableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -439,6 +582,8 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fConnectToMas
             pnode->fMasternode = true;
         }
 
+        SocketEventsAdd(pnode);
+
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
 
@@ -458,6 +603,7 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint("net", "disconnecting peer=%d\n", id);
+        SocketEventsRemove(hSocket);
         CloseSocket(hSocket);
     }
 
@@ -710,26 +856,79 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
     return true;
 }
 
+//
+// Receive buffers of processed messages are kept for new ones, so that the
+// stream of small messages from busy peers doesn't allocate and wipe a buffer
+// for each of them.
+//
+
+/** Largest buffer kept for reuse, bigger ones are freed */
+static const size_t MAX_POOLED_RECV_BUFFER_SIZE = 16 * 1024;
+/** Maximum number of buffers kept for reuse */
+static const size_t MAX_RECV_BUFFER_POOL = 1024;
+
+static std::vector<CSerializeData> vRecvBufferPool;
+static CCriticalSection cs_vRecvBufferPool;
+
+/** Hand vRecv a buffer from the pool, if there is one */
+static void AcquireRecvBuffer(CDataStream& vRecv)
+{
+    LOCK(cs_vRecvBufferPool);
+    if (vRecvBufferPool.empty())
+        return;
+    vRecv.SwapBuffer(vRecvBufferPool.back());
+    vRecvBufferPool.pop_back();
+}
+
+void ReleaseRecvBuffer(CSerializeData& vch)
+{
+    if (vch.capacity() == 0 || vch.capacity() > MAX_POOLED_RECV_BUFFER_SIZE)
+        return;
+
+    LOCK(cs_vRecvBufferPool);
+    if (vRecvBufferPool.size() >= MAX_RECV_BUFFER_POOL)
+        return;
+    // reserved up front, the pool never moves the buffers it holds
+    if (vRecvBufferPool.capacity() < MAX_RECV_BUFFER_POOL)
+        vRecvBufferPool.reserve(MAX_RECV_BUFFER_POOL);
+    vch.clear();
+    vRecvBufferPool.push_back(CSerializeData());
+    vRecvBufferPool.back().swap(vch);
+}
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData vch;
+    vRecv.SwapBuffer(vch);
+    ReleaseRecvBuffer(vch);
+}
+
+const uint256& CNetMessage::GetMessageHash() const
+{
+    assert(complete());
+    if (data_hash.IsNull())
+        hasher.Finalize(data_hash.begin());
+    return data_hash;
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
+    unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     memcpy(&hdrbuf[nHdrPos], pch, nCopy);
     nHdrPos += nCopy;
 
     // if header incomplete, exit
-    if (nHdrPos < 24)
+    if (nHdrPos < CMessageHeader::HEADER_SIZE)
         return nCopy;
 
-    // deserialize to CMessageHeader
-    try {
-        hdrbuf >> hdr;
-    }
-    catch (const std::exception&) {
-        return -1;
-    }
+    // deserialize to CMessageHeader, same layout as its serialization
+    memcpy(hdr.pchMessageStart, hdrbuf, MESSAGE_START_SIZE);
+    memcpy(hdr.pchCommand, hdrbuf + MESSAGE_START_SIZE, CMessageHeader::COMMAND_SIZE);
+    hdr.nMessageSize = ReadLE32((const unsigned char*)hdrbuf + CMessageHeader::MESSAGE_SIZE_OFFSET);
+    hdr.nChecksum = ReadLE32((const unsigned char*)hdrbuf + CMessageHeader::CHECKSUM_OFFSET);
 
     // reject messages larger than MAX_SIZE
     if (hdr.nMessageSize > MAX_SIZE)
@@ -738,6 +937,9 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    if (hdr.nMessageSize > 0 && hdr.nMessageSize <= MAX_POOLED_RECV_BUFFER_SIZE)
+        AcquireRecvBuffer(vRecv);
+
     return nCopy;
 }
 
@@ -751,6 +953,7 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
         vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
     }
 
+    hasher.Write((const unsigned char*)pch, nCopy);
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
@@ -768,10 +971,10 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSendBufferRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        const CSerializeData &data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -961,7 +1164,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!IsServiceableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1006,92 +1209,172 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint("net", "connection from %s accepted\n", addr.ToString());
 
+    SocketEventsAdd(pnode);
+
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
-void ThreadSocketHandler()
+static void DisconnectNodes(unsigned int& nPrevNodeCount)
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true)
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*> vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            if (pnode->fDisconnect ||
+                (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
             {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
-                {
-                    LogPrintf("ThreadSocketHandler -- removing node: peer=%d addr=%s nRefCount=%d fNetworkNode=%d fInbound=%d fMasternode=%d\n",
-                              pnode->id, pnode->addr.ToString(), pnode->GetRefCount(), pnode->fNetworkNode, pnode->fInbound, pnode->fMasternode);
+                LogPrintf("ThreadSocketHandler -- removing node: peer=%d addr=%s nRefCount=%d fNetworkNode=%d fInbound=%d fMasternode=%d\n",
+                          pnode->id, pnode->addr.ToString(), pnode->GetRefCount(), pnode->fNetworkNode, pnode->fInbound, pnode->fMasternode);
 
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
-                    pnode->grantMasternodeOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
+                pnode->grantMasternodeOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    if (pnode->fMasternode)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                if (pnode->fNetworkNode || pnode->fInbound)
+                    pnode->Release();
+                if (pnode->fMasternode)
+                    pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
         {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0)
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                bool fDelete = false;
                 {
-                    bool fDelete = false;
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend)
                     {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend)
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv)
                         {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv)
-                            {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
+                            TRY_LOCK(pnode->cs_inventory, lockInv);
+                            if (lockInv)
+                                fDelete = true;
                         }
                     }
-                    if (fDelete)
-                    {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
-                    }
+                }
+                if (fDelete)
+                {
+                    vNodesDisconnected.remove(pnode);
+                    delete pnode;
                 }
             }
         }
-        if(vNodes.size() != nPrevNodeCount) {
-            nPrevNodeCount = vNodes.size();
-            uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+    if(vNodes.size() != nPrevNodeCount) {
+        nPrevNodeCount = vNodes.size();
+        uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+// requires LOCK(cs_vRecvMsg)
+/** Whether a complete message waits for processing and the receive buffer is full */
+static bool IsReceiveFlooded(CNode* pnode)
+{
+    return !pnode->vRecvMsg.empty() && pnode->vRecvMsg.front().complete() &&
+           pnode->GetTotalRecvSize() > ReceiveFloodSize();
+}
+
+// requires LOCK(cs_vRecvMsg)
+/** Receive from the socket once, returns false when there was nothing left to read */
+static bool SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        return true;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
         }
+    }
+    return false;
+}
+
+static void InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+static void ThreadSocketHandlerSelect()
+{
+    unsigned int nPrevNodeCount = 0;
+    while (true)
+    {
+        //
+        // Disconnect nodes
+        //
+        DisconnectNodes(nPrevNodeCount);
 
         //
         // Find which sockets have data to receive
         //
         struct timeval timeout;
         timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+        timeout.tv_usec = SOCKET_EVENTS_INTERVAL * 1000; // frequency to poll pnode->vSend
 
         fd_set fdsetRecv;
         fd_set fdsetSend;
@@ -1142,9 +1425,7 @@ void ThreadSocketHandler()
                 }
                 {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    if (lockRecv && !IsReceiveFlooded(pnode))
                         FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
@@ -1196,39 +1477,7 @@ void ThreadSocketHandler()
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
-                {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                    SocketRecvData(pnode);
             }
 
             //
@@ -1246,34 +1495,166 @@ void ThreadSocketHandler()
             //
             // Inactivity checking
             //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+            InactivityCheck(pnode);
+        }
+        ReleaseNodeVector(vNodesCopy);
+    }
+}
+
+#ifdef USE_EPOLL
+/** Remember that pnode's socket became ready, epoll won't report it again until we hit EAGAIN */
+static void SetSocketReady(std::set<CNode*>& setReady, CNode* pnode)
+{
+    if (setReady.insert(pnode).second)
+        pnode->AddRef();
+}
+
+static void ThreadSocketHandlerEpoll()
+{
+    unsigned int nPrevNodeCount = 0;
+    int64_t nLastDisconnect = 0;
+    int64_t nLastInactivityCheck = 0;
+    // Readiness reported for these sockets but not used up yet, nodes are referenced
+    std::set<CNode*> setRecvReady;
+    std::set<CNode*> setSendReady;
+    bool fMoreData = false;
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    while (true)
+    {
+        int64_t nNow = GetTimeMillis();
+        if (nNow - nLastDisconnect >= SOCKET_EVENTS_INTERVAL) {
+            DisconnectNodes(nPrevNodeCount);
+            nLastDisconnect = nNow;
+        }
+        if (nNow - nLastInactivityCheck >= 1000) {
+            vector<CNode*> vNodesCopy = CopyNodeVector();
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                if (pnode->hSocket != INVALID_SOCKET)
+                    InactivityCheck(pnode);
+            ReleaseNodeVector(vNodesCopy);
+            nLastInactivityCheck = nNow;
+        }
+
+        // don't block while sockets still have data to read
+        int nEvents = epoll_wait(hEpollFd, events, MAX_SOCKET_EVENTS, fMoreData ? 0 : SOCKET_EVENTS_INTERVAL);
+        boost::this_thread::interruption_point();
+
+        if (nEvents == SOCKET_ERROR)
+        {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR) {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                MilliSleep(SOCKET_EVENTS_INTERVAL);
+            }
+            nEvents = 0;
+        }
+
+        for (int i = 0; i < nEvents; i++)
+        {
+            void* ptr = events[i].data.ptr;
+            if (ptr == NULL) {
+                // send queues filled up by other threads, reset the eventfd before taking them
+                uint64_t nSignals;
+                if (read(hWakeupFd, &nSignals, sizeof(nSignals)) != sizeof(nSignals))
+                    LogPrint("net", "socket handler wakeup read failed: %s\n", NetworkErrorString(errno));
+                std::vector<CNode*> vNodesWakeup;
                 {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
+                    LOCK(cs_vNodesSendWakeup);
+                    vNodesWakeup.swap(vNodesSendWakeup);
                 }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
+                BOOST_FOREACH(CNode* pnode, vNodesWakeup) {
+                    SetSocketReady(setSendReady, pnode);
+                    pnode->Release();
                 }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
+                continue;
+            }
+
+            bool fListenSocket = false;
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+                if (ptr == &hListenSocket) {
+                    AcceptConnection(hListenSocket);
+                    fListenSocket = true;
+                    break;
+                }
+            }
+            if (fListenSocket)
+                continue;
+
+            CNode* pnode = static_cast<CNode*>(ptr);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                SetSocketReady(setRecvReady, pnode);
+            if (events[i].events & EPOLLOUT)
+                SetSocketReady(setSendReady, pnode);
+        }
+
+        //
+        // Send, anything not sent now comes back with the next EPOLLOUT
+        //
+        for (std::set<CNode*>::iterator it = setSendReady.begin(); it != setSendReady.end(); )
+        {
+            CNode* pnode = *it;
+            if (pnode->hSocket != INVALID_SOCKET) {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (!lockSend) {
+                    ++it;
+                    continue;
                 }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+                if (!pnode->vSendMsg.empty())
+                    SocketSendData(pnode);
+            }
+            setSendReady.erase(it++);
+            pnode->Release();
+        }
+
+        //
+        // Receive, one buffer per socket and round so that busy peers can't starve the others.
+        // As with select(), nodes drain their send queue before we read more from them,
+        // and nothing is read while a full receive buffer waits for the message handler.
+        //
+        fMoreData = false;
+        for (std::set<CNode*>::iterator it = setRecvReady.begin(); it != setRecvReady.end(); )
+        {
+            boost::this_thread::interruption_point();
+
+            CNode* pnode = *it;
+            bool fDone = pnode->hSocket == INVALID_SOCKET;
+            if (!fDone) {
+                bool fSendPending;
                 {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    fSendPending = !lockSend || !pnode->vSendMsg.empty();
+                }
+                if (!fSendPending) {
+                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                    if (lockRecv && !IsReceiveFlooded(pnode)) {
+                        if (SocketRecvData(pnode))
+                            fMoreData = true;
+                        else
+                            fDone = true;
+                    }
                 }
             }
+            if (fDone) {
+                setRecvReady.erase(it++);
+                pnode->Release();
+            } else {
+                ++it;
+            }
         }
-        ReleaseNodeVector(vNodesCopy);
     }
 }
+#endif
+
+void ThreadSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (fSocketEventsEpoll) {
+        ThreadSocketHandlerEpoll();
+        return;
+    }
+#endif
+    ThreadSocketHandlerSelect();
+}
 
 
 
@@ -1738,6 +2119,102 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
+namespace {
+    /** A message waiting for a message worker */
+    struct CWorkerMessage
+    {
+        std::string strCommand;
+        CDataStream vRecv;
+        size_t nSize;
+
+        CWorkerMessage(const std::string& strCommandIn, int nTypeIn, int nVersionIn) :
+            strCommand(strCommandIn), vRecv(nTypeIn, nVersionIn), nSize(0) {}
+    };
+}
+
+static boost::mutex mutexWorkerQueue;
+static boost::condition_variable condWorkerQueue;
+/** Messages waiting for the workers per peer, the nodes are referenced while they have an entry */
+static std::map<CNode*, std::deque<CWorkerMessage> > mapWorkerQueues;
+/** Peers with queued messages which no worker is busy with, in the order they get served */
+static std::deque<CNode*> vWorkerQueueReady;
+
+bool QueueWorkerMessage(CNode* pnode, const std::string& strCommand, CDataStream& vRecv)
+{
+    if (nMessageWorkers <= 0)
+        return false;
+
+    boost::unique_lock<boost::mutex> lock(mutexWorkerQueue);
+    std::map<CNode*, std::deque<CWorkerMessage> >::iterator it = mapWorkerQueues.find(pnode);
+    if (it == mapWorkerQueues.end()) {
+        // a worker busy with this peer keeps the entry until it is done, and serves the new message next
+        it = mapWorkerQueues.insert(std::make_pair(pnode, std::deque<CWorkerMessage>())).first;
+        pnode->AddRef();
+        vWorkerQueueReady.push_back(pnode);
+        condWorkerQueue.notify_one();
+    }
+    it->second.push_back(CWorkerMessage(strCommand, vRecv.GetType(), vRecv.GetVersion()));
+    CWorkerMessage& msg = it->second.back();
+    CSerializeData vch;
+    vRecv.SwapBuffer(vch);
+    msg.vRecv.SwapBuffer(vch);
+    msg.nSize = msg.vRecv.size();
+    pnode->nWorkerQueueSize += msg.nSize;
+    return true;
+}
+
+void ThreadMessageWorker()
+{
+    while (true)
+    {
+        CNode* pnode;
+        CWorkerMessage* pmsg;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexWorkerQueue);
+            while (vWorkerQueueReady.empty())
+                condWorkerQueue.wait(lock);
+            pnode = vWorkerQueueReady.front();
+            vWorkerQueueReady.pop_front();
+            // only we take messages of this peer off its queue, and appending doesn't move them
+            pmsg = &mapWorkerQueues[pnode].front();
+        }
+
+        if (!pnode->fDisconnect) {
+            try {
+                g_signals.ProcessWorkerMessage(pnode, pmsg->strCommand, pmsg->vRecv);
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, "ThreadMessageWorker()");
+            } catch (const boost::thread_interrupted&) {
+                throw;
+            } catch (...) {
+                PrintExceptionContinue(NULL, "ThreadMessageWorker()");
+            }
+        }
+        boost::this_thread::interruption_point();
+
+        CSerializeData vch;
+        pmsg->vRecv.SwapBuffer(vch);
+        ReleaseRecvBuffer(vch);
+
+        bool fDone = false;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexWorkerQueue);
+            std::map<CNode*, std::deque<CWorkerMessage> >::iterator it = mapWorkerQueues.find(pnode);
+            pnode->nWorkerQueueSize -= pmsg->nSize;
+            it->second.pop_front();
+            if (it->second.empty()) {
+                mapWorkerQueues.erase(it);
+                fDone = true;
+            } else {
+                // go to the back of the line, other peers are waiting too
+                vWorkerQueueReady.push_back(pnode);
+            }
+        }
+        if (fDone)
+            pnode->Release();
+    }
+}
+
 void ThreadMessageHandler()
 {
     boost::mutex condition_mutex;
@@ -1763,7 +2240,7 @@ void ThreadMessageHandler()
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->fDisconnect = true;
 
-                    if (pnode->nSendSize < SendBufferSize())
+                    if (pnode->nSendSize < SendBufferSize() && pnode->nWorkerQueueSize < ReceiveFloodSize())
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                         {
@@ -1998,6 +2475,7 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
     // Send and receive from sockets, accept connections
+    SocketEventsInit();
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
     // Initiate outbound connections from -addnode
@@ -2012,6 +2490,10 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Process messages
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
 
+    // Process the messages handed off by the message handler
+    for (int i = 0; i < nMessageWorkers; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgworker", &ThreadMessageWorker));
+
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
 }
@@ -2061,6 +2543,14 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+#ifdef USE_EPOLL
+        if (hWakeupFd != -1)
+            close(hWakeupFd);
+        if (hEpollFd != -1)
+            close(hEpollFd);
+        hWakeupFd = hEpollFd = -1;
+        vNodesSendWakeup.clear();
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete semMasternodeOutbound;
@@ -2135,10 +2625,39 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 }
 
 void RelayInv(CInv &inv, const int minProtoVersion) {
-    LOCK(cs_vNodes);
-    BOOST_FOREACH(CNode* pnode, vNodes)
-        if(pnode->nVersion >= minProtoVersion)
-            pnode->PushInventory(inv);
+    LOCK(cs_vRelayInvQueue);
+    // Expire items which peers didn't pull in time, they won't get them anymore
+    int64_t nNow = GetTime();
+    while (!vRelayInvQueue.empty() && vRelayInvQueue.front().nTime < nNow - RELAY_INV_QUEUE_TIMEOUT)
+        vRelayInvQueue.pop_front();
+
+    LogPrint("net", "RelayInv -- inv: %s\n", inv.ToString());
+    vRelayInvQueue.push_back(CRelayInvEntry(nNow, minProtoVersion, inv));
+    nRelayInvQueueEnd++;
+}
+
+void CNode::PullRelayInventory()
+{
+    std::vector<CInv> vInv;
+    {
+        LOCK(cs_vRelayInvQueue);
+        uint64_t nQueueBegin = nRelayInvQueueEnd - vRelayInvQueue.size();
+        if (nRelayInvSeq < nQueueBegin) {
+            LogPrint("net", "CNode::PullRelayInventory -- %d items expired before they were pulled, peer=%d\n", nQueueBegin - nRelayInvSeq, id);
+            nRelayInvSeq = nQueueBegin;
+        }
+        for (size_t i = nRelayInvSeq - nQueueBegin; i < vRelayInvQueue.size(); i++) {
+            if (nVersion >= vRelayInvQueue[i].nMinProtoVersion)
+                vInv.push_back(vRelayInvQueue[i].inv);
+        }
+        nRelayInvSeq = nRelayInvQueueEnd;
+    }
+    if (vInv.empty())
+        return;
+
+    LogPrint("net", "CNode::PullRelayInventory -- pulled %d items, peer=%d\n", vInv.size(), id);
+    LOCK(cs_inventory);
+    vInventoryToSend.insert(vInventoryToSend.end(), vInv.begin(), vInv.end());
 }
 
 void CNode::RecordBytesRecv(uint64_t bytes)
@@ -2422,6 +2941,7 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    nWorkerQueueSize = 0;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2429,6 +2949,10 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
     nNextInvSend = 0;
+    {
+        LOCK(cs_vRelayInvQueue);
+        nRelayInvSeq = nRelayInvQueueEnd;
+    }
     fRelayTxes = false;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
@@ -2471,22 +2995,25 @@ CNode::~CNode()
 
 void CNode::AskFor(const CInv& inv)
 {
-    if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ) {
-        int64_t nNow = GetTime();
-        if(nNow - nLastWarningTime > WARNING_INTERVAL) {
-            LogPrintf("CNode::AskFor -- WARNING: inventory message dropped: mapAskFor.size = %d, setAskFor.size = %d, MAPASKFOR_MAX_SZ = %d, SETASKFOR_MAX_SZ = %d, nSkipped = %d, peer=%d\n",
-                      mapAskFor.size(), setAskFor.size(), MAPASKFOR_MAX_SZ, SETASKFOR_MAX_SZ, nNumWarningsSkipped, id);
-            nLastWarningTime = nNow;
-            nNumWarningsSkipped = 0;
-        }
-        else {
-            ++nNumWarningsSkipped;
+    {
+        LOCK(cs_askFor);
+        if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ) {
+            int64_t nNow = GetTime();
+            if(nNow - nLastWarningTime > WARNING_INTERVAL) {
+                LogPrintf("CNode::AskFor -- WARNING: inventory message dropped: mapAskFor.size = %d, setAskFor.size = %d, MAPASKFOR_MAX_SZ = %d, SETASKFOR_MAX_SZ = %d, nSkipped = %d, peer=%d\n",
+                          mapAskFor.size(), setAskFor.size(), MAPASKFOR_MAX_SZ, SETASKFOR_MAX_SZ, nNumWarningsSkipped, id);
+                nLastWarningTime = nNow;
+                nNumWarningsSkipped = 0;
+            }
+            else {
+                ++nNumWarningsSkipped;
+            }
+            return;
         }
-        return;
+        // a peer may not have multiple non-responded queue positions for a single inv item
+        if (!setAskFor.insert(inv.hash).second)
+            return;
     }
-    // a peer may not have multiple non-responded queue positions for a single inv item
-    if (!setAskFor.insert(inv.hash).second)
-        return;
 
     // We're using mapAskFor as a priority queue,
     // the key is the earliest time the request can be sent
@@ -2515,6 +3042,69 @@ void CNode::AskFor(const CInv& inv)
     mapAskFor.insert(std::make_pair(nRequestTime, inv));
 }
 
+// requires LOCK(cs_mapRelayMessageCache)
+static void EraseRelayMessageCacheEntry(const CInv& inv)
+{
+    map<CInv, CSendBufferRef>::iterator it = mapRelayMessageCache.find(inv);
+    if (it == mapRelayMessageCache.end())
+        return;
+    nRelayMessageCacheSize -= it->second->size();
+    mapRelayMessageCache.erase(it);
+}
+
+CSendBufferRef GetRelayMessageCache(const CInv& inv)
+{
+    LOCK(cs_mapRelayMessageCache);
+    map<CInv, CSendBufferRef>::iterator it = mapRelayMessageCache.find(inv);
+    if (it == mapRelayMessageCache.end())
+        return CSendBufferRef();
+    return it->second;
+}
+
+void AddRelayMessageCache(const CInv& inv, const CSendBufferRef& msg)
+{
+    LOCK(cs_mapRelayMessageCache);
+    // Expire old messages, and the oldest ones if the cache is full
+    int64_t nNow = GetTime();
+    while (!vRelayMessageCacheExpiration.empty() &&
+           (vRelayMessageCacheExpiration.front().first < nNow ||
+            nRelayMessageCacheSize + msg->size() > MAX_RELAY_MESSAGE_CACHE_SIZE))
+    {
+        EraseRelayMessageCacheEntry(vRelayMessageCacheExpiration.front().second);
+        vRelayMessageCacheExpiration.pop_front();
+    }
+    if (msg->size() > MAX_RELAY_MESSAGE_CACHE_SIZE)
+        return;
+
+    EraseRelayMessageCacheEntry(inv);
+    mapRelayMessageCache.insert(std::make_pair(inv, msg));
+    nRelayMessageCacheSize += msg->size();
+    vRelayMessageCacheExpiration.push_back(std::make_pair(nNow + RELAY_MESSAGE_CACHE_TIMEOUT, inv));
+}
+
+void EraseRelayMessageCache(const CInv& inv)
+{
+    LOCK(cs_mapRelayMessageCache);
+    EraseRelayMessageCacheEntry(inv);
+}
+
+// Fill in the size and checksum of the message in ssMsg, which starts with its header
+static unsigned int SetMessageSizeAndChecksum(CDataStream& ssMsg)
+{
+    // Set the size
+    unsigned int nSize = ssMsg.size() - CMessageHeader::HEADER_SIZE;
+    WriteLE32((uint8_t*)&ssMsg[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+
+    // Set the checksum
+    uint256 hash = Hash(ssMsg.begin() + CMessageHeader::HEADER_SIZE, ssMsg.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ssMsg.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ssMsg[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    return nSize;
+}
+
 void CNode::BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend)
 {
     ENTER_CRITICAL_SECTION(cs_vSend);
@@ -2551,28 +3141,56 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
         LEAVE_CRITICAL_SECTION(cs_vSend);
         return;
     }
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    WriteLE32((uint8_t*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
-
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    unsigned int nSize = SetMessageSizeAndChecksum(ssSend);
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    boost::shared_ptr<CSerializeData> pdata(new CSerializeData());
+    ssSend.GetAndClear(*pdata);
+    QueueSendBuffer(pdata);
+
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
+
+CSendBufferRef CNode::SerializeMessage(const char* pszCommand, const CDataStream& ssPayload)
+{
+    CDataStream ssMsg(SER_NETWORK, INIT_PROTO_VERSION);
+    ssMsg.reserve(CMessageHeader::HEADER_SIZE + ssPayload.size());
+    ssMsg << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+    ssMsg += ssPayload;
+    SetMessageSizeAndChecksum(ssMsg);
+
+    boost::shared_ptr<CSerializeData> pdata(new CSerializeData());
+    ssMsg.GetAndClear(*pdata);
+    return pdata;
+}
+
+void CNode::PushSerializedMessage(const CSendBufferRef& msg)
+{
+    // Shared buffers can't be fuzzed, they are only dropped for -dropmessagestest
+    if (mapArgs.count("-dropmessagestest") && GetRand(GetArg("-dropmessagestest", 2)) == 0)
+    {
+        LogPrint("net", "dropmessages DROPPING SEND MESSAGE\n");
+        return;
+    }
+
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: serialized message (%d bytes) peer=%d\n", msg->size() - CMessageHeader::HEADER_SIZE, id);
+    QueueSendBuffer(msg);
+}
+
+void CNode::QueueSendBuffer(const CSendBufferRef& msg)
+{
+    std::deque<CSendBufferRef>::iterator it = vSendMsg.insert(vSendMsg.end(), msg);
+    nSendSize += msg->size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (it == vSendMsg.begin()) {
         SocketSendData(this);
-
-    LEAVE_CRITICAL_SECTION(cs_vSend);
+        // the socket handler takes care of the rest
+        if (!vSendMsg.empty())
+            WakeupSocketHandler(this);
+    }
 }
 
 std::vector<unsigned char> CNode::CalculateKeyedNetGroup(CAddress& address)
@@ -8,6 +8,7 @@
 
 #include "bloom.h"
 #include "compat.h"
+#include "hash.h"
 #include "limitedmap.h"
 #include "netbase.h"
 #include "protocol.h"
@@ -26,12 +27,16 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 
 class CAddrMan;
 class CScheduler;
 class CNode;
 
+/** A complete message, header included, which can be queued to several peers without copying it */
+typedef boost::shared_ptr<const CSerializeData> CSendBufferRef;
+
 namespace boost {
     class thread_group;
 } // namespace boost
@@ -58,6 +63,22 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
+/** -socketevents default: edge-triggered epoll where available, select() otherwise */
+#ifdef USE_EPOLL
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** -messageworkers default */
+static const int DEFAULT_MESSAGE_WORKERS = 2;
+/** Maximum number of message worker threads */
+static const int MAX_MESSAGE_WORKERS = 16;
+/** Time in seconds a serialized relay message is kept for other peers asking for the same object */
+static const int64_t RELAY_MESSAGE_CACHE_TIMEOUT = 5 * 60;
+/** Maximum total size of the serialized relay messages kept */
+static const size_t MAX_RELAY_MESSAGE_CACHE_SIZE = 32 * 1000 * 1000;
+/** Time in seconds an inventory item relayed with RelayInv waits for peers to pull it */
+static const int64_t RELAY_INV_QUEUE_TIMEOUT = 15 * 60;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of entries in setAskFor (larger due to getdata latency)*/
@@ -95,6 +116,25 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/**
+ * Hand a message to the message worker threads, which pass it to the
+ * ProcessWorkerMessage signal. Messages of a peer are processed one at a
+ * time and in the order they were queued. The data is moved out of vRecv.
+ * Returns false if there are no workers, the caller has to process the
+ * message itself then.
+ */
+bool QueueWorkerMessage(CNode* pnode, const std::string& strCommand, CDataStream& vRecv);
+/** Returns the -socketevents modes supported by this build, for help and error messages */
+std::string GetSupportedSocketEvents();
+/**
+ * Serialized messages of relayed objects by inventory, so that the getdata
+ * requests of many peers for the same object don't serialize it each time.
+ * Entries expire after RELAY_MESSAGE_CACHE_TIMEOUT, objects which change under
+ * the same hash have to erase theirs when they do.
+ */
+CSendBufferRef GetRelayMessageCache(const CInv& inv);
+void AddRelayMessageCache(const CInv& inv, const CSendBufferRef& msg);
+void EraseRelayMessageCache(const CInv& inv);
 
 typedef int NodeId;
 
@@ -119,6 +159,7 @@ struct CNodeSignals
     boost::signals2::signal<int ()> GetHeight;
     boost::signals2::signal<bool (CNode*), CombinerAll> ProcessMessages;
     boost::signals2::signal<bool (CNode*), CombinerAll> SendMessages;
+    boost::signals2::signal<void (CNode*, std::string&, CDataStream&)> ProcessWorkerMessage;
     boost::signals2::signal<void (NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void (NodeId)> FinalizeNode;
 };
@@ -162,6 +203,10 @@ extern CAddrMan addrman;
 
 /** Maximum number of connections to simultaneously allow (aka connection slots) */
 extern int nMaxConnections;
+/** Whether ThreadSocketHandler waits on epoll instead of select() (-socketevents) */
+extern bool fSocketEventsEpoll;
+/** Number of threads processing messages handed off by QueueWorkerMessage (-messageworkers) */
+extern int nMessageWorkers;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
@@ -214,11 +259,19 @@ public:
 
 
 
+/**
+ * A message being received. The data goes into a buffer recycled from earlier
+ * messages where possible, and its checksum is computed as the bytes arrive.
+ */
 class CNetMessage {
+private:
+    mutable CHash256 hasher;
+    mutable uint256 data_hash;
+
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    char hdrbuf[CMessageHeader::HEADER_SIZE]; // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
@@ -226,15 +279,18 @@ public:
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
+    bool fSignersPrefetched;        // signatures handed to the signer recovery threads
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fSignersPrefetched = false;
     }
 
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -244,14 +300,19 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
+    /** Double SHA256 of the message data, the message has to be complete */
+    const uint256& GetMessageHash() const;
+
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
 };
 
+/** Return a message buffer to the pool of receive buffers, or free it if the pool is full */
+void ReleaseRecvBuffer(CSerializeData& vch);
+
 
 typedef enum BanReason
 {
@@ -325,12 +386,13 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSendBufferRef> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    size_t nWorkerQueueSize; // total size of the messages queued for the message workers
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -401,6 +463,10 @@ public:
     CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
+    // next entry of the RelayInv queue to pull, see PullRelayInventory()
+    uint64_t nRelayInvSeq;
+    // setAskFor is also cleared by the message workers, see RemoveAskFor()
+    CCriticalSection cs_askFor;
     std::set<uint256> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
     int64_t nNextInvSend;
@@ -443,6 +509,9 @@ private:
 
     CCriticalSection cs_nRefCount;
 
+    // requires LOCK(cs_vSend)
+    void QueueSendBuffer(const CSendBufferRef& msg);
+
     CNode(const CNode&);
     void operator=(const CNode&);
 
@@ -536,6 +605,13 @@ public:
         }
     }
 
+    /**
+     * Move the items relayed with RelayInv since the last call to
+     * vInventoryToSend, all of them at once. Called by the message handler
+     * thread only, before it sends the inventory to this peer.
+     */
+    void PullRelayInventory();
+
     void PushBlockHash(const uint256 &hash)
     {
         LOCK(cs_inventory);
@@ -544,6 +620,13 @@ public:
 
     void AskFor(const CInv& inv);
 
+    /** Stop expecting the inventory item with this hash, it arrived */
+    void RemoveAskFor(const uint256& hash)
+    {
+        LOCK(cs_askFor);
+        setAskFor.erase(hash);
+    }
+
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
     void BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend);
 
@@ -553,6 +636,11 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    /** Build a complete message out of an already serialized payload, for PushSerializedMessage */
+    static CSendBufferRef SerializeMessage(const char* pszCommand, const CDataStream& ssPayload);
+    /** Queue a message built by SerializeMessage, the buffer is shared and not copied */
+    void PushSerializedMessage(const CSendBufferRef& msg);
+
     void PushVersion();
 
 
@@ -840,6 +928,10 @@ public:
 class CTransaction;
 void RelayTransaction(const CTransaction& tx);
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+/**
+ * Relay inv to all peers of at least minProtoVersion. The item is queued once
+ * and the peers pull it with the other queued items in CNode::PullRelayInventory.
+ */
 void RelayInv(CInv &inv, const int minProtoVersion = MIN_PEER_PROTO_VERSION);
 
 /** Access to the (IP) address database (peers.dat) */
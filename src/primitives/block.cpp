@@ -11,7 +11,7 @@
 #include "utilstrencodings.h"
 #include "crypto/common.h"
 
-uint256 CBlockHeader::GetHash() const
+uint256 CBlockHeader::ComputeHash() const
 {
         uint256 thash;
         unsigned int profile = 0x0;
@@ -20,6 +20,25 @@ uint256 CBlockHeader::GetHash() const
 
 }
 
+uint256 CBlockHeader::GetHash() const
+{
+    const unsigned char* pheader = (const unsigned char*)&nVersion;
+    if (fHashCached && memcmp(vchHashCachedHeader, pheader, HEADER_SIZE) == 0)
+        return hashCached;
+
+    hashCached = ComputeHash();
+    memcpy(vchHashCachedHeader, pheader, HEADER_SIZE);
+    fHashCached = true;
+    return hashCached;
+}
+
+void CBlockHeader::SetCachedHash(const uint256& hash)
+{
+    hashCached = hash;
+    memcpy(vchHashCachedHeader, &nVersion, HEADER_SIZE);
+    fHashCached = true;
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -20,6 +20,9 @@
 class CBlockHeader
 {
 public:
+    // Size of the serialized header; neoscrypt hashes these bytes in place.
+    static const size_t HEADER_SIZE = 80;
+
     // header
     int32_t nVersion;
     uint256 hashPrevBlock;
@@ -28,6 +31,15 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
+    // memory only
+    // neoscrypt is memory-hard, so GetHash() remembers the last result together
+    // with the header bytes it was computed from. The header fields are public
+    // and modified in place (e.g. by the miner), so a cached hash is only reused
+    // while those bytes are unchanged.
+    mutable uint256 hashCached;
+    mutable unsigned char vchHashCachedHeader[HEADER_SIZE];
+    mutable bool fHashCached;
+
     CBlockHeader()
     {
         SetNull();
@@ -54,6 +66,7 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -63,6 +76,16 @@ public:
 
     uint256 GetHash() const;
 
+    /** Compute the hash without consulting or updating the cache. */
+    uint256 ComputeHash() const;
+
+    /**
+     * Seed the hash cache with a hash known to belong to the current header
+     * fields (e.g. taken from a validated block index entry). The caller is
+     * responsible for the hash being correct; it is not recomputed.
+     */
+    void SetCachedHash(const uint256& hash);
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -118,6 +141,9 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
+        block.hashCached     = hashCached;
+        memcpy(block.vchHashCachedHeader, vchHashCachedHeader, HEADER_SIZE);
+        block.fHashCached    = fHashCached;
         return block;
     }
 
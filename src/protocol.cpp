@@ -64,6 +64,8 @@ const char *SYNCSTATUSCOUNT="ssc";
 const char *MNGOVERNANCESYNC="govsync";
 const char *MNGOVERNANCEOBJECT="govobj";
 const char *MNGOVERNANCEOBJECTVOTE="govobjvote";
+const char *MNGOVERNANCEVOTESYNC="govvotesync";
+const char *MNGOVERNANCEVOTES="govvotes";
 const char *MNVERIFY="mnv";
 };
 
@@ -143,6 +145,8 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::MNGOVERNANCESYNC,
     NetMsgType::MNGOVERNANCEOBJECT,
     NetMsgType::MNGOVERNANCEOBJECTVOTE,
+    NetMsgType::MNGOVERNANCEVOTESYNC,
+    NetMsgType::MNGOVERNANCEVOTES,
     NetMsgType::MNVERIFY,
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes+ARRAYLEN(allNetMessageTypes));
@@ -243,6 +243,8 @@ extern const char *SYNCSTATUSCOUNT;
 extern const char *MNGOVERNANCESYNC;
 extern const char *MNGOVERNANCEOBJECT;
 extern const char *MNGOVERNANCEOBJECTVOTE;
+extern const char *MNGOVERNANCEVOTESYNC;
+extern const char *MNGOVERNANCEVOTES;
 extern const char *MNVERIFY;
 };
 
@@ -693,15 +693,23 @@ UniValue gobject(const UniValue& params, bool fHelp)
     // GETVOTES FOR SPECIFIC GOVERNANCE OBJECT
     if(strCommand == "getvotes")
     {
-        if (params.size() != 2)
+        if (params.size() != 2 && params.size() != 4)
             throw std::runtime_error(
-                "Correct usage is 'gobject getvotes <governance-hash>'"
+                "Correct usage is 'gobject getvotes <governance-hash> [txid vout_index]'"
                 );
 
         // COLLECT PARAMETERS FROM USER
 
         uint256 hash = ParseHashV(params[1], "Governance hash");
 
+        CTxIn mnCollateralOutpoint;
+        if (params.size() == 4) {
+            uint256 txid = ParseHashV(params[2], "Masternode Collateral hash");
+            std::string strVout = params[3].get_str();
+            uint32_t vout = boost::lexical_cast<uint32_t>(strVout);
+            mnCollateralOutpoint = CTxIn(txid, vout);
+        }
+
         // FIND OBJECT USER IS LOOKING FOR
 
         LOCK(governance.cs);
@@ -718,9 +726,18 @@ UniValue gobject(const UniValue& params, bool fHelp)
 
         // GET MATCHING VOTES BY HASH, THEN SHOW USERS VOTE INFORMATION
 
-        std::vector<CGovernanceVote> vecVotes = governance.GetMatchingVotes(hash);
-        BOOST_FOREACH(CGovernanceVote vote, vecVotes) {
-            bResult.push_back(Pair(vote.GetHash().ToString(),  vote.ToString()));
+        const CGovernanceObjectVoteFile& fileVotes = pGovObj->GetVoteFile();
+        if (mnCollateralOutpoint == CTxIn()) {
+            for (CGovernanceObjectVoteFile::vote_l_cit it = fileVotes.begin(); it != fileVotes.end(); ++it) {
+                bResult.push_back(Pair(it->GetHash().ToString(),  it->ToString()));
+            }
+        }
+        else {
+            std::pair<CGovernanceObjectVoteFile::vote_mn_m_cit, CGovernanceObjectVoteFile::vote_mn_m_cit> range =
+                fileVotes.GetMasternodeVotes(mnCollateralOutpoint.prevout);
+            for (CGovernanceObjectVoteFile::vote_mn_m_cit it = range.first; it != range.second; ++it) {
+                bResult.push_back(Pair(it->second->GetHash().ToString(),  it->second->ToString()));
+            }
         }
 
         return bResult;
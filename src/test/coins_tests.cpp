@@ -347,4 +347,43 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     BOOST_CHECK(spent_a_duplicate_coinbase);
 }
 
+BOOST_AUTO_TEST_CASE(coins_prefetch)
+{
+    CCoinsViewTest base;
+    std::vector<uint256> vTxid;
+    {
+        CCoinsViewCacheTest cache(&base);
+        for (int i = 0; i < 10; i++) {
+            vTxid.push_back(GetRandHash());
+            CCoinsModifier coins = cache.ModifyCoins(vTxid.back());
+            coins->vout.resize(1);
+            coins->vout[0].nValue = i;
+            coins->nHeight = 1;
+        }
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // A middle cache with a newer version of one entry, like pcoinsTip
+    CCoinsViewCacheTest middle(&base);
+    middle.ModifyCoins(vTxid[3])->vout[0].nValue = 100;
+    CCoinsViewCacheTest top(&middle);
+    BOOST_CHECK(top.AccessCoins(vTxid[0]));
+
+    std::vector<uint256> vPrefetch(vTxid);
+    vPrefetch.push_back(GetRandHash()); // not in any view
+    // already cached entries are not loaded again
+    BOOST_CHECK_EQUAL(top.PrefetchCoins(vPrefetch), 9U);
+    BOOST_CHECK_EQUAL(top.PrefetchCoins(vPrefetch), 0U);
+    BOOST_CHECK_EQUAL(top.GetCacheSize(), 10U);
+    BOOST_CHECK_EQUAL(middle.GetCacheSize(), 10U);
+    for (int i = 0; i < 10; i++) {
+        BOOST_CHECK(top.HaveCoinsInCache(vTxid[i]));
+        BOOST_CHECK_EQUAL(top.AccessCoins(vTxid[i])->vout[0].nValue, i == 3 ? 100 : i);
+    }
+    BOOST_CHECK(!top.HaveCoinsInCache(vPrefetch.back()));
+    top.SelfTest();
+    middle.SelfTest();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
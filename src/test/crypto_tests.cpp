@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/neoscrypt.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -53,6 +54,15 @@ void TestSHA256(const std::string &in, const std::string &hexout) { TestVector(C
 void TestSHA512(const std::string &in, const std::string &hexout) { TestVector(CSHA512(), in, ParseHex(hexout));}
 void TestRIPEMD160(const std::string &in, const std::string &hexout) { TestVector(CRIPEMD160(), in, ParseHex(hexout));}
 
+void TestNeoScrypt(unsigned int profile, const std::string &hexout) {
+    unsigned char in[80];
+    for (int i=0; i<80; i++)
+        in[i] = (unsigned char)i;
+    std::vector<unsigned char> hash(32);
+    neoscrypt(in, &hash[0], profile);
+    BOOST_CHECK(hash == ParseHex(hexout));
+}
+
 void TestHMACSHA256(const std::string &hexkey, const std::string &hexin, const std::string &hexout) {
     std::vector<unsigned char> key = ParseHex(hexkey);
     TestVector(CHMAC_SHA256(&key[0], key.size()), ParseHex(hexin), ParseHex(hexout));
@@ -248,4 +258,11 @@ BOOST_AUTO_TEST_CASE(hmac_sha512_testvectors) {
                    "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
 }
 
+BOOST_AUTO_TEST_CASE(neoscrypt_testvectors) {
+    // Checked against the portable kernels; the test setup has already
+    // switched to whatever neoscrypt_autodetect() picked for this processor.
+    TestNeoScrypt(0x0, "7258961afb33fd12d00cacb8d63f4f4f52bb6917043865dd24a08f578853122d");
+    TestNeoScrypt(0x1, "e7b750adf02489d88d7ee8e76009516ce44d36c4a07d7cfae4c4cba498a64b3c");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
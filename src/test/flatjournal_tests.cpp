@@ -0,0 +1,160 @@
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flat-database.h"
+
+#include "test/test_neobytes.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+class CJournalTestObject
+{
+public:
+    std::map<int, std::string> mapEntries;
+    int64_t nValue;
+    int nCheckAndRemoveCalls;
+
+    CJournalTestObject() : nValue(0), nCheckAndRemoveCalls(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nValue);
+        READWRITE(mapEntries);
+    }
+
+    template <typename Journal>
+    void JournalOp(Journal& journal) {
+        journal.Value(0, nValue);
+        journal.Map(1, mapEntries);
+        journal.Commit();
+    }
+
+    void Clear() { mapEntries.clear(); nValue = 0; }
+    void CheckAndRemove() { nCheckAndRemoveCalls++; }
+    std::string ToString() const { return strprintf("Entries: %d, value: %d", (int)mapEntries.size(), nValue); }
+};
+
+int64_t JournalSize()
+{
+    return boost::filesystem::file_size(GetDataDir() / "test.log");
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(flatjournal_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(flatjournal_roundtrip)
+{
+    CFlatJournalDB<CJournalTestObject> journal("test.log", "test.dat", "magicTest");
+    CJournalTestObject obj;
+    for (int i = 0; i < 100; i++)
+        obj.mapEntries[i] = strprintf("entry %d", i);
+    obj.nValue = 42;
+    BOOST_CHECK(journal.Flush(obj));
+    int64_t nFullSize = JournalSize();
+
+    // only the changes get appended
+    obj.mapEntries[5] = "changed";
+    obj.mapEntries.erase(7);
+    obj.mapEntries[1000] = "added";
+    BOOST_CHECK(journal.Flush(obj));
+    int64_t nAppendedSize = JournalSize() - nFullSize;
+    BOOST_CHECK(nAppendedSize > 0);
+    BOOST_CHECK(nAppendedSize < nFullSize / 10);
+
+    // nothing changed, only a commit marker
+    BOOST_CHECK(journal.Flush(obj));
+    BOOST_CHECK_EQUAL(JournalSize() - nFullSize - nAppendedSize, FlatJournalRecordSize(1));
+
+    CFlatJournalDB<CJournalTestObject> journalLoad("test.log", "test.dat", "magicTest");
+    CJournalTestObject objLoaded;
+    BOOST_CHECK(journalLoad.Load(objLoaded));
+    BOOST_CHECK(objLoaded.mapEntries == obj.mapEntries);
+    BOOST_CHECK_EQUAL(objLoaded.nValue, 42);
+    BOOST_CHECK_EQUAL(objLoaded.nCheckAndRemoveCalls, 1);
+
+    // the loaded index lets the next flush append again
+    objLoaded.mapEntries[6] = "changed too";
+    int64_t nSizeBefore = JournalSize();
+    BOOST_CHECK(journalLoad.Flush(objLoaded));
+    BOOST_CHECK(JournalSize() - nSizeBefore < nFullSize / 10);
+
+    CJournalTestObject objReloaded;
+    BOOST_CHECK(journal.Load(objReloaded));
+    BOOST_CHECK(objReloaded.mapEntries == objLoaded.mapEntries);
+}
+
+BOOST_AUTO_TEST_CASE(flatjournal_interrupted_write)
+{
+    CFlatJournalDB<CJournalTestObject> journal("test.log", "test.dat", "magicTest");
+    CJournalTestObject obj;
+    obj.mapEntries[1] = "one";
+    obj.mapEntries[2] = "two";
+    BOOST_CHECK(journal.Flush(obj));
+    int64_t nCommittedSize = JournalSize();
+
+    // a record without a commit marker and a torn one after it
+    obj.mapEntries[3] = "three";
+    BOOST_CHECK(journal.Flush(obj));
+    FILE* file = fopen((GetDataDir() / "test.log").string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    BOOST_CHECK(TruncateFile(file, JournalSize() - FlatJournalRecordSize(1)));
+    fseek(file, 0, SEEK_END);
+    const char pchTorn[] = {0x10, 0x00, 0x00, 0x00, 0x01};
+    fwrite(pchTorn, sizeof(pchTorn), 1, file);
+    fclose(file);
+
+    CJournalTestObject objLoaded;
+    BOOST_CHECK(journal.Load(objLoaded));
+    BOOST_CHECK_EQUAL(objLoaded.mapEntries.size(), 2U);
+    BOOST_CHECK(objLoaded.mapEntries.count(3) == 0);
+    BOOST_CHECK_EQUAL(JournalSize(), nCommittedSize);
+}
+
+BOOST_AUTO_TEST_CASE(flatjournal_corrupted_record)
+{
+    CFlatJournalDB<CJournalTestObject> journal("test.log", "test.dat", "magicTest");
+    CJournalTestObject obj;
+    obj.mapEntries[1] = "one";
+    BOOST_CHECK(journal.Flush(obj));
+
+    // flip a byte of the value
+    FILE* file = fopen((GetDataDir() / "test.log").string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, JournalSize() - FlatJournalRecordSize(1) - sizeof(uint256) - 1, SEEK_SET);
+    fputc('x', file);
+    fclose(file);
+
+    CJournalTestObject objLoaded;
+    BOOST_CHECK(!journal.Load(objLoaded));
+    BOOST_CHECK(objLoaded.mapEntries.empty());
+}
+
+BOOST_AUTO_TEST_CASE(flatjournal_legacy_migration)
+{
+    CJournalTestObject obj;
+    obj.mapEntries[1] = "one";
+    obj.nValue = 7;
+    CFlatDB<CJournalTestObject> flatdb("test.dat", "magicTest");
+    BOOST_CHECK(flatdb.Dump(obj));
+
+    // read back from the old flat file, which goes away once the journal is written
+    CFlatJournalDB<CJournalTestObject> journal("test.log", "test.dat", "magicTest");
+    CJournalTestObject objLoaded;
+    BOOST_CHECK(journal.Load(objLoaded));
+    BOOST_CHECK(objLoaded.mapEntries == obj.mapEntries);
+    BOOST_CHECK_EQUAL(objLoaded.nValue, 7);
+    BOOST_CHECK(journal.Flush(objLoaded));
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "test.dat"));
+
+    CJournalTestObject objReloaded;
+    BOOST_CHECK(journal.Load(objReloaded));
+    BOOST_CHECK(objReloaded.mapEntries == obj.mapEntries);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
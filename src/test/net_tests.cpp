@@ -0,0 +1,158 @@
+// Copyright (c) 2021-2024 The NeoBytes Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "hash.h"
+#include "net.h"
+#include "protocol.h"
+#include "random.h"
+#include "serialize.h"
+#include "streams.h"
+#include "test/test_neobytes.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(net_tests, BasicTestingSetup)
+
+/** Feed a message to a CNetMessage in chunks of nChunkSize bytes, like the socket handler does */
+static bool ReceiveInChunks(CNetMessage& msg, const CDataStream& ssMsg, unsigned int nChunkSize)
+{
+    const char* pch = &ssMsg[0];
+    unsigned int nBytes = ssMsg.size();
+    while (nBytes > 0) {
+        unsigned int nChunk = std::min(nChunkSize, nBytes);
+        while (nChunk > 0) {
+            int handled = msg.in_data ? msg.readData(pch, nChunk) : msg.readHeader(pch, nChunk);
+            if (handled < 0)
+                return false;
+            pch += handled;
+            nChunk -= handled;
+            nBytes -= handled;
+        }
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(netmessage_receive)
+{
+    std::vector<unsigned char> vPayload;
+    for (int i = 0; i < 1000; i++)
+        vPayload.push_back(i * 7);
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+
+    CMessageHeader hdr(Params().MessageStart(), "test", vPayload.size());
+    memcpy(&hdr.nChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+    ssMsg << hdr;
+    ssMsg.write((const char*)&vPayload[0], vPayload.size());
+
+    unsigned int vChunkSizes[] = {1, 7, 24, 100, 5000};
+    for (unsigned int i = 0; i < sizeof(vChunkSizes) / sizeof(vChunkSizes[0]); i++) {
+        unsigned int nChunkSize = vChunkSizes[i];
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+        BOOST_CHECK(ReceiveInChunks(msg, ssMsg, nChunkSize));
+        BOOST_CHECK(msg.complete());
+        BOOST_CHECK(msg.hdr.IsValid(Params().MessageStart()));
+        BOOST_CHECK_EQUAL(msg.hdr.GetCommand(), "test");
+        BOOST_CHECK_EQUAL(msg.hdr.nMessageSize, vPayload.size());
+        BOOST_CHECK_EQUAL(msg.hdr.nChecksum, hdr.nChecksum);
+        BOOST_CHECK(msg.GetMessageHash() == hash);
+        BOOST_CHECK(std::vector<unsigned char>(msg.vRecv.begin(), msg.vRecv.end()) == vPayload);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(netmessage_oversized)
+{
+    CMessageHeader hdr(Params().MessageStart(), "test", MAX_SIZE + 1);
+    CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+    ssMsg << hdr;
+
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(!ReceiveInChunks(msg, ssMsg, ssMsg.size()));
+}
+
+BOOST_AUTO_TEST_CASE(netmessage_empty)
+{
+    CMessageHeader hdr(Params().MessageStart(), "verack", 0);
+    CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+    ssMsg << hdr;
+
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(ReceiveInChunks(msg, ssMsg, ssMsg.size()));
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(msg.GetMessageHash() == Hash(msg.vRecv.begin(), msg.vRecv.end()));
+}
+
+BOOST_AUTO_TEST_CASE(serialized_message)
+{
+    CDataStream ssPayload(SER_NETWORK, PROTOCOL_VERSION);
+    ssPayload << std::string("payload") << (uint32_t)42;
+    CSendBufferRef msg = CNode::SerializeMessage("test", ssPayload);
+    BOOST_CHECK_EQUAL(msg->size(), CMessageHeader::HEADER_SIZE + ssPayload.size());
+
+    CDataStream ssMsg(msg->begin(), msg->end(), SER_NETWORK, PROTOCOL_VERSION);
+    CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(ReceiveInChunks(netmsg, ssMsg, ssMsg.size()));
+    BOOST_CHECK(netmsg.complete());
+    BOOST_CHECK_EQUAL(netmsg.hdr.GetCommand(), "test");
+    BOOST_CHECK_EQUAL(netmsg.hdr.nMessageSize, ssPayload.size());
+    BOOST_CHECK(memcmp(netmsg.GetMessageHash().begin(), &netmsg.hdr.nChecksum, CMessageHeader::CHECKSUM_SIZE) == 0);
+
+    std::string str;
+    uint32_t n;
+    netmsg.vRecv >> str >> n;
+    BOOST_CHECK_EQUAL(str, "payload");
+    BOOST_CHECK_EQUAL(n, 42U);
+}
+
+BOOST_AUTO_TEST_CASE(relay_message_cache)
+{
+    CDataStream ssPayload(SER_NETWORK, PROTOCOL_VERSION);
+    ssPayload << (uint32_t)1;
+    CInv inv(MSG_MASTERNODE_PING, GetRandHash());
+    CSendBufferRef msg = CNode::SerializeMessage(NetMsgType::MNPING, ssPayload);
+
+    BOOST_CHECK(!GetRelayMessageCache(inv));
+    AddRelayMessageCache(inv, msg);
+    // the same buffer is handed out, not a copy of it
+    BOOST_CHECK(GetRelayMessageCache(inv) == msg);
+    BOOST_CHECK(!GetRelayMessageCache(CInv(MSG_MASTERNODE_ANNOUNCE, inv.hash)));
+
+    CSendBufferRef msgNew = CNode::SerializeMessage(NetMsgType::MNPING, ssPayload);
+    AddRelayMessageCache(inv, msgNew);
+    BOOST_CHECK(GetRelayMessageCache(inv) == msgNew);
+
+    EraseRelayMessageCache(inv);
+    BOOST_CHECK(!GetRelayMessageCache(inv));
+}
+
+BOOST_AUTO_TEST_CASE(relay_inventory_queue)
+{
+    CInv invBefore(MSG_SPORK, GetRandHash());
+    RelayInv(invBefore);
+
+    CNode node(INVALID_SOCKET, CAddress(), "", true);
+    node.nVersion = PROTOCOL_VERSION;
+    CInv inv1(MSG_MASTERNODE_PING, GetRandHash());
+    CInv inv2(MSG_GOVERNANCE_OBJECT, GetRandHash());
+    CInv inv3(MSG_MASTERNODE_PAYMENT_VOTE, GetRandHash());
+    RelayInv(inv1);
+    RelayInv(inv2, PROTOCOL_VERSION + 1);
+    RelayInv(inv3);
+
+    // only the items relayed after the peer connected, for its protocol version
+    node.PullRelayInventory();
+    BOOST_CHECK_EQUAL(node.vInventoryToSend.size(), 2U);
+    BOOST_CHECK(node.vInventoryToSend[0].hash == inv1.hash);
+    BOOST_CHECK(node.vInventoryToSend[1].hash == inv3.hash);
+
+    // each item is pulled once
+    node.PullRelayInventory();
+    BOOST_CHECK_EQUAL(node.vInventoryToSend.size(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -96,4 +96,32 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* The cached header hash must follow in-place changes to the header fields */
+BOOST_AUTO_TEST_CASE(block_header_hash_cache)
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.nTime = 1408732505;
+    header.nBits = 0x1b06b2f1;
+    header.nNonce = 1;
+
+    uint256 hash = header.GetHash();
+    BOOST_CHECK(hash == header.ComputeHash());
+    BOOST_CHECK(hash == header.GetHash());
+
+    header.nNonce++;
+    BOOST_CHECK(header.GetHash() != hash);
+    BOOST_CHECK(header.GetHash() == header.ComputeHash());
+
+    CBlock block(header);
+    BOOST_CHECK(block.GetHash() == header.GetHash());
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == header.GetHash());
+
+    block.nNonce--;
+    BOOST_CHECK(block.GetHash() == hash);
+
+    block.SetNull();
+    BOOST_CHECK(block.GetHash() == block.ComputeHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
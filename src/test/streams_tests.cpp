@@ -64,4 +64,28 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
             std::string(ds.begin(), ds.end()));  
 }         
 
+BOOST_AUTO_TEST_CASE(streams_swapbuffer)
+{
+    CDataStream ds(SER_NETWORK, PROTOCOL_VERSION);
+    ds << (uint32_t)1 << (uint32_t)2 << (uint32_t)3;
+    uint32_t n;
+    ds >> n;
+    BOOST_CHECK_EQUAL(n, 1U);
+
+    // only the unread data is handed out
+    CSerializeData vch;
+    vch.reserve(100);
+    ds.SwapBuffer(vch);
+    BOOST_CHECK_EQUAL(vch.size(), 8U);
+    BOOST_CHECK(ds.empty());
+
+    CDataStream ds2(SER_NETWORK, PROTOCOL_VERSION);
+    ds2.SwapBuffer(vch);
+    BOOST_CHECK(vch.empty());
+    ds2 >> n;
+    BOOST_CHECK_EQUAL(n, 2U);
+    ds2 >> n;
+    BOOST_CHECK_EQUAL(n, 3U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
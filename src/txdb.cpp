@@ -7,13 +7,17 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "hash.h"
 #include "main.h"
-#include "pow.h"
 #include "uint256.h"
 
+#include <deque>
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -41,6 +45,82 @@ bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
     return db.Read(make_pair(DB_COINS, txid), coins);
 }
 
+namespace {
+/** Closure reading the coins of one transaction on a ThreadCoinsDBRead thread */
+class CCoinsReadCheck
+{
+private:
+    const CCoinsViewDB *pview;
+    uint256 txid;
+    CCoins *pcoins;
+    char *pfFound;
+
+public:
+    CCoinsReadCheck() : pview(NULL), pcoins(NULL), pfFound(NULL) {}
+    CCoinsReadCheck(const CCoinsViewDB *pviewIn, const uint256 &txidIn, CCoins *pcoinsIn, char *pfFoundIn) :
+        pview(pviewIn), txid(txidIn), pcoins(pcoinsIn), pfFound(pfFoundIn) {}
+
+    bool operator()() {
+        try {
+            *pfFound = pview->GetCoins(txid, *pcoins);
+        } catch (const std::exception&) {
+            // read it again in the calling thread, which handles the error
+            return false;
+        }
+        return true;
+    }
+
+    void swap(CCoinsReadCheck &check) {
+        std::swap(pview, check.pview);
+        std::swap(txid, check.txid);
+        std::swap(pcoins, check.pcoins);
+        std::swap(pfFound, check.pfFound);
+    }
+};
+}
+
+static CCheckQueue<CCoinsReadCheck> coinsreadqueue(16);
+// CCheckQueue supports only one master at a time
+static boost::mutex mutexCoinsReadQueue;
+
+void ThreadCoinsDBRead() {
+    RenameThread("neobytes-coinsrd");
+    coinsreadqueue.Thread();
+}
+
+void CCoinsViewDB::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const {
+    // Sorted like the keys in the database, so neighbouring reads hit the same blocks
+    std::vector<uint256> vSorted(vTxid);
+    std::sort(vSorted.begin(), vSorted.end());
+    vSorted.erase(std::unique(vSorted.begin(), vSorted.end()), vSorted.end());
+
+    std::vector<CCoins> vCoins(vSorted.size());
+    std::vector<char> vFound(vSorted.size(), 0);
+    bool fOk;
+    {
+        // The queue is processed from the back, add the reads in reverse
+        std::vector<CCoinsReadCheck> vChecks;
+        vChecks.reserve(vSorted.size());
+        for (size_t i = vSorted.size(); i-- > 0; )
+            vChecks.push_back(CCoinsReadCheck(this, vSorted[i], &vCoins[i], &vFound[i]));
+
+        boost::unique_lock<boost::mutex> lock(mutexCoinsReadQueue);
+        coinsreadqueue.Add(vChecks);
+        fOk = coinsreadqueue.Wait();
+    }
+    if (!fOk) {
+        CCoinsView::GetCoinsBatch(vTxid, vCoinsRet);
+        return;
+    }
+
+    for (size_t i = 0; i < vSorted.size(); i++) {
+        if (!vFound[i])
+            continue;
+        vCoinsRet.push_back(std::make_pair(vSorted[i], CCoins()));
+        vCoinsRet.back().second.swap(vCoins[i]);
+    }
+}
+
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
     return db.Exists(make_pair(DB_COINS, txid));
 }
@@ -307,45 +387,141 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+/**
+ * Reads the block index entries on a thread of its own, so the LevelDB scan
+ * and deserialization of one batch overlap with LoadBlockIndexGuts() adding
+ * the previous one to mapBlockIndex.
+ */
+class CBlockIndexReader
+{
+private:
+    static const size_t BATCH_SIZE = 1024;
+    static const size_t MAX_QUEUED_BATCHES = 16;
+
+    boost::scoped_ptr<CDBIterator> pcursor;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::vector<CDiskBlockIndex> > queue;
+    //! Whether all entries were read, and whether that failed
+    bool fDone;
+    bool fError;
+    //! Whether the consumer went away early
+    bool fAbort;
+    boost::thread thread;
+
+    //! Hand over a full batch; false if the consumer went away
+    bool Push(std::vector<CDiskBlockIndex>& vBatch)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queue.size() >= MAX_QUEUED_BATCHES && !fAbort)
+            cond.wait(lock);
+        if (fAbort)
+            return false;
+        queue.push_back(std::vector<CDiskBlockIndex>());
+        queue.back().swap(vBatch);
+        cond.notify_all();
+        return true;
+    }
+
+    void Run()
+    {
+        std::vector<CDiskBlockIndex> vBatch;
+        bool fOk = true;
+        vBatch.reserve(BATCH_SIZE);
+        while (pcursor->Valid()) {
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+                break;
+            vBatch.push_back(CDiskBlockIndex());
+            if (!pcursor->GetValue(vBatch.back())) {
+                vBatch.pop_back();
+                fOk = false;
+                break;
+            }
+            pcursor->Next();
+            if (vBatch.size() == BATCH_SIZE) {
+                if (!Push(vBatch))
+                    return;
+                vBatch.reserve(BATCH_SIZE);
+            }
+        }
+        if (!vBatch.empty() && !Push(vBatch))
+            return;
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fDone = true;
+        fError = !fOk;
+        cond.notify_all();
+    }
+
+public:
+    CBlockIndexReader(CDBIterator* pcursorIn) : pcursor(pcursorIn), fDone(false), fError(false), fAbort(false)
+    {
+        thread = boost::thread(boost::bind(&CBlockIndexReader::Run, this));
+    }
+
+    ~CBlockIndexReader()
+    {
+        boost::this_thread::disable_interruption di;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fAbort = true;
+            cond.notify_all();
+        }
+        thread.join();
+    }
+
+    /**
+     * Wait for the next batch of entries. Returns false once there are no
+     * more, with fErrorOut telling whether reading them failed.
+     */
+    bool Next(std::vector<CDiskBlockIndex>& vBatch, bool& fErrorOut)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queue.empty() && !fDone)
+            cond.wait(lock);
+        if (queue.empty()) {
+            fErrorOut = fError;
+            return false;
+        }
+        vBatch.swap(queue.front());
+        queue.pop_front();
+        cond.notify_all();
+        return true;
+    }
+};
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    CDBIterator* pcursor = NewIterator();
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    // Load mapBlockIndex; the caller checks the proof of work of the entries
+    CBlockIndexReader reader(pcursor);
+    std::vector<CDiskBlockIndex> vBatch;
+    bool fReadError = false;
+    while (reader.Next(vBatch, fReadError)) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
-            }
-        } else {
-            break;
+        BOOST_FOREACH(const CDiskBlockIndex& diskindex, vBatch) {
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
         }
     }
+    if (fReadError)
+        return error("LoadBlockIndex() : failed to read value");
 
     return true;
 }
@@ -44,12 +44,17 @@ public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    /** Reads the coins in key order, spread over the ThreadCoinsDBRead threads */
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
 };
 
+/** Run an instance of the thread reading coins for CCoinsViewDB::GetCoinsBatch */
+void ThreadCoinsDBRead();
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
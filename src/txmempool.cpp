@@ -992,6 +992,11 @@ bool CCoinsViewMemPool::GetCoins(const uint256 &txid, CCoins &coins) const {
     return (base->GetCoins(txid, coins) && !coins.IsPruned());
 }
 
+void CCoinsViewMemPool::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<std::pair<uint256, CCoins> > &vCoinsRet) const {
+    // One at a time through GetCoins, which looks at the mempool first
+    CCoinsView::GetCoinsBatch(vTxid, vCoinsRet);
+}
+
 bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
     return mempool.exists(txid) || base->HaveCoins(txid);
 }
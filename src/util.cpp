@@ -41,6 +41,7 @@
 
 #include <algorithm>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 
@@ -795,6 +796,69 @@ void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length) {
 #endif
 }
 
+CFileView::CFileView() : pdata(NULL), nSize(0), fMapped(false)
+{
+}
+
+CFileView::~CFileView()
+{
+    Close();
+}
+
+bool CFileView::Open(const boost::filesystem::path& path)
+{
+    Close();
+    FILE *file = fopen(path.string().c_str(), "rb");
+    if (!file)
+        return false;
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        return false;
+    }
+    long nFileSize = ftell(file);
+    if (nFileSize < 0) {
+        fclose(file);
+        return false;
+    }
+    nSize = nFileSize;
+    if (nSize == 0) {
+        fclose(file);
+        return true;
+    }
+#ifndef WIN32
+    void *pmap = mmap(NULL, nSize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (pmap != MAP_FAILED) {
+        fclose(file);
+        posix_madvise(pmap, nSize, POSIX_MADV_SEQUENTIAL);
+        pdata = (const unsigned char*)pmap;
+        fMapped = true;
+        return true;
+    }
+#endif
+    // no mapping, read it instead
+    vchData.resize(nSize);
+    bool fRead = fseek(file, 0, SEEK_SET) == 0 && fread(&vchData[0], 1, nSize, file) == nSize;
+    fclose(file);
+    if (!fRead) {
+        Close();
+        return false;
+    }
+    pdata = &vchData[0];
+    return true;
+}
+
+void CFileView::Close()
+{
+#ifndef WIN32
+    if (fMapped)
+        munmap((void*)pdata, nSize);
+#endif
+    std::vector<unsigned char>().swap(vchData);
+    pdata = NULL;
+    nSize = 0;
+    fMapped = false;
+}
+
 void ShrinkDebugFile()
 {
     // Scroll debug.log if it's getting too big
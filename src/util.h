@@ -162,6 +162,34 @@ void OpenDebugLog();
 void ShrinkDebugFile();
 void runCommand(const std::string& strCommand);
 
+/**
+ * Read-only view of the contents of a file: memory mapped where possible,
+ * so that large files can be parsed without copying them into memory first.
+ */
+class CFileView
+{
+private:
+    const unsigned char* pdata;
+    size_t nSize;
+    bool fMapped;
+    std::vector<unsigned char> vchData; // contents, when they could not be mapped
+
+    // Disallow copies
+    CFileView(const CFileView&);
+    CFileView& operator=(const CFileView&);
+
+public:
+    CFileView();
+    ~CFileView();
+
+    bool Open(const boost::filesystem::path& path);
+    void Close();
+
+    const unsigned char* begin() const { return pdata; }
+    const unsigned char* end() const { return pdata + nSize; }
+    size_t size() const { return nSize; }
+};
+
 inline bool IsSwitchChar(char c)
 {
 #ifdef WIN32